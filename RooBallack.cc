@@ -42,11 +42,17 @@ RooBallack::RooBallack(const RooBallack& other, const char* name) :
   width("width", this, other.width), 
   tail("tail", this, other.tail), 
   alpha("alpha", this, other.alpha),
-  n("n", this, other.n)
+  n("n", this, other.n),
+  _genTable(other._genTable)
 {
 }
 
 Double_t RooBallack::evaluate() const 
+{
+  return evalAt(x);
+}
+
+Double_t RooBallack::evalAt(Double_t x) const 
 {
   // build the functional form
 
@@ -114,3 +120,44 @@ Double_t RooBallack::evaluate() const
   }
 
 }
+
+Int_t RooBallack::getGenerator(const RooArgSet& directVars,
+                               RooArgSet &generateVars,
+                               Bool_t /* staticInitOK */) const
+{
+  if (matchArgs(directVars, generateVars, x)) return 1;
+  return 0;
+}
+
+void RooBallack::initGenerator(Int_t code)
+{
+  assert(code==1);
+  // tabulate the shape over the range of x, only if params or range changed
+  const Int_t nCells = 1000;
+  TArrayD state(7);
+  state[0] = mean;
+  state[1] = width;
+  state[2] = tail;
+  state[3] = alpha;
+  state[4] = n;
+  state[5] = x.min();
+  state[6] = x.max();
+  if (_genTable.isUpToDate(state)) return;
+  TArrayD values(nCells+1), midValues(nCells);
+  double step = (x.max() - x.min())/nCells;
+  for (int i=0; i<=nCells; i++) values[i] = evalAt(x.min() + i*step);
+  for (int i=0; i<nCells; i++) midValues[i] = evalAt(x.min() + (i+.5)*step);
+  _genTable.setGrid(x.min(), x.max(), values, &midValues);
+}
+
+void RooBallack::generateEvent(Int_t code)
+{
+  assert(code==1);
+  // draw from the inverted tabulated CDF,
+  // corrected to the exact shape by accept/reject
+  Double_t xval;
+  do {
+    xval = _genTable.generate(x.min(), x.max());
+  } while (!_genTable.accept(xval, evalAt(xval)));
+  x = xval;
+}
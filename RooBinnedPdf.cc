@@ -97,7 +97,8 @@ RooBinnedPdf::RooBinnedPdf(const RooBinnedPdf& other, const char* name) :
   RooAbsPdf(other, name), 
   _x("x", this, other._x), 
   _coefList("coefList",this,other._coefList),
-  _nBins(other._nBins)
+  _nBins(other._nBins),
+  _genTable(other._genTable)
 {
   // Copy constructor
   (other._limits).Copy(_limits);
@@ -205,6 +206,48 @@ Double_t RooBinnedPdf::localEval(const Double_t xval) const
 }
 
 
+Int_t RooBinnedPdf::getGenerator(const RooArgSet& directVars, RooArgSet &generateVars, Bool_t /* staticInitOK */) const
+{
+  if (matchArgs(directVars, generateVars, _x)) return 1;
+  return 0;
+}
+
+
+void RooBinnedPdf::initGenerator(Int_t code)
+{
+  assert(code==1) ;
+
+  // Rebuild the cumulative bin integrals only if the coefficients changed
+  TArrayD coefs(_nBins>0 ? _nBins-1 : 0);
+  for (int i=0; i<coefs.GetSize(); ++i) {
+    coefs[i] = static_cast<RooAbsReal*>(_coefList.at(i))->getVal();
+  }
+  if (_genTable.isUpToDate(coefs)) return;
+
+  // Same bin integrals as in localEval: b_i = p_i (1 - sum_{j<i} b_j)
+  TArrayD binInts(_nBins);
+  double sum(0);
+  for (int i=0; i<_nBins-1; ++i) {
+    binInts[i] = (1-sum)*coefs[i];
+    sum += binInts[i];
+  }
+  if (_nBins>0) binInts[_nBins-1] = 1-sum;
+  _genTable.setBins(_limits, binInts);
+}
+
+
+void RooBinnedPdf::generateEvent(Int_t code)
+{
+  assert(code==1) ;
+
+  // Draw directly from the inverted cumulative table
+  Double_t min(_x.min()); Double_t max(_x.max());
+  if (min<_limits[0]) min = _limits[0];
+  if (max>_limits[_nBins]) max = _limits[_nBins];
+  _x = _genTable.generate(min, max);
+}
+
+
 Int_t RooBinnedPdf::getnBins(){
   return _nBins;
 }
@@ -42,11 +42,17 @@ RooCruijff::RooCruijff(const RooCruijff& other, const char* name) :
   sigmaL("sigmaL", this, other.sigmaL), 
   sigmaR("sigmaR", this, other.sigmaR), 
   alphaL("alphaL", this, other.alphaL), 
-  alphaR("alphaR", this, other.alphaR)
+  alphaR("alphaR", this, other.alphaR),
+  _genTable(other._genTable)
 {
 }
 
 Double_t RooCruijff::evaluate() const 
+{
+  return evalAt(x);
+}
+
+Double_t RooCruijff::evalAt(Double_t x) const 
 {
   // build the functional form
   double sigma = 0.0;
@@ -62,3 +68,44 @@ Double_t RooCruijff::evaluate() const
   double f = 2*sigma*sigma + alpha*dx*dx ;
   return exp(-dx*dx/f) ;
 }
+
+Int_t RooCruijff::getGenerator(const RooArgSet& directVars,
+                               RooArgSet &generateVars,
+                               Bool_t /* staticInitOK */) const
+{
+  if (matchArgs(directVars, generateVars, x)) return 1;
+  return 0;
+}
+
+void RooCruijff::initGenerator(Int_t code)
+{
+  assert(code==1);
+  // tabulate the shape over the range of x, only if params or range changed
+  const Int_t nCells = 1000;
+  TArrayD state(7);
+  state[0] = m0;
+  state[1] = sigmaL;
+  state[2] = sigmaR;
+  state[3] = alphaL;
+  state[4] = alphaR;
+  state[5] = x.min();
+  state[6] = x.max();
+  if (_genTable.isUpToDate(state)) return;
+  TArrayD values(nCells+1), midValues(nCells);
+  double step = (x.max() - x.min())/nCells;
+  for (int i=0; i<=nCells; i++) values[i] = evalAt(x.min() + i*step);
+  for (int i=0; i<nCells; i++) midValues[i] = evalAt(x.min() + (i+.5)*step);
+  _genTable.setGrid(x.min(), x.max(), values, &midValues);
+}
+
+void RooCruijff::generateEvent(Int_t code)
+{
+  assert(code==1);
+  // draw from the inverted tabulated CDF,
+  // corrected to the exact shape by accept/reject
+  Double_t xval;
+  do {
+    xval = _genTable.generate(x.min(), x.max());
+  } while (!_genTable.accept(xval, evalAt(xval)));
+  x = xval;
+}
@@ -0,0 +1,120 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides BCPGenDecay Pdf with per-event convolution cache
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides BCPGenDecay Pdf with per-event convolution cache
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+
+#include "RooArgSet.h"
+#include "RooRealVar.h"
+
+#include "RooRarBCPGenDecay.hh"
+
+ClassImp(RooRarBCPGenDecay)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param t The observable (deltaT)
+/// \param tag The flavor tag
+/// \param tau The lifetime
+/// \param dm The mixing frequency
+/// \param avgMistag The average mistag rate
+/// \param a The C param
+/// \param b The S param
+/// \param delMistag The mistag rate difference
+/// \param mu The tagging efficiency difference
+/// \param model The resolution model
+/// \param type The decay type
+RooRarBCPGenDecay::RooRarBCPGenDecay(const char *name, const char *title,
+                                     RooRealVar& t, RooAbsCategory& tag,
+                                     RooAbsReal& tau, RooAbsReal& dm,
+                                     RooAbsReal& avgMistag,
+                                     RooAbsReal& a, RooAbsReal& b,
+                                     RooAbsReal& delMistag, RooAbsReal& mu,
+                                     const RooResolutionModel& model,
+                                     DecayType type)
+  : RooBCPGenDecay(name, title, t, tag, tau, dm, avgMistag, a, b,
+                   delMistag, mu, model, type)
+{
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+///
+/// The caches are not copied.
+RooRarBCPGenDecay::RooRarBCPGenDecay(const RooRarBCPGenDecay& other,
+                                     const char* name)
+  : RooBCPGenDecay(other, name),
+    _convCache(other._convCache), _normCache(other._normCache)
+{
+}
+
+RooRarBCPGenDecay::~RooRarBCPGenDecay()
+{
+}
+
+/// \brief Evaluate from cached basis functions
+/// \return Unnormalized value
+Double_t RooRarBCPGenDecay::evaluate() const
+{
+  return _convCache.evaluate(*this, _convSet);
+}
+
+/// \brief Integrate from cached basis integrals
+/// \param code Integration code
+/// \param normSet Normalization set
+/// \param rangeName Range name
+/// \return The integral
+///
+/// Only the unnormalized integral over the full range is cached,
+/// which is the one used for the normalization;
+/// others are left to RooBCPGenDecay.
+Double_t RooRarBCPGenDecay::analyticalIntegralWN(Int_t code,
+                                                 const RooArgSet* normSet,
+                                                 const char* rangeName) const
+{
+  if ((code<=0)||rangeName)
+    return RooBCPGenDecay::analyticalIntegralWN(code, normSet, rangeName);
+  RooArgSet *intCoefSet, *intConvSet, *normCoefSet, *normConvSet;
+  _codeReg.retrieve(code-1, intCoefSet, intConvSet, normCoefSet, normConvSet);
+  if (normCoefSet||normConvSet)
+    return RooBCPGenDecay::analyticalIntegralWN(code, normSet, rangeName);
+  return _normCache.integral(*this, _convSet, intCoefSet, intConvSet, code);
+}
+
+/// \brief Drop the caches when servers are redirected
+///
+/// The leaves of the basis functions (eg, observables attached to dataset)
+/// are looked up again at next evaluation.
+Bool_t RooRarBCPGenDecay::redirectServersHook(const RooAbsCollection&
+                                              newServerList,
+                                              Bool_t mustReplaceAll,
+                                              Bool_t nameChange,
+                                              Bool_t isRecursive)
+{
+  _convCache.reset();
+  _normCache.reset();
+  return RooBCPGenDecay::redirectServersHook(newServerList, mustReplaceAll,
+                                             nameChange, isRecursive);
+}
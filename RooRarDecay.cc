@@ -0,0 +1,106 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides Decay Pdf with per-event convolution cache
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides Decay Pdf with per-event convolution cache
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+
+#include "RooArgSet.h"
+#include "RooRealVar.h"
+
+#include "RooRarDecay.hh"
+
+ClassImp(RooRarDecay)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param t The observable (deltaT)
+/// \param tau The lifetime
+/// \param model The resolution model
+/// \param type The decay type
+RooRarDecay::RooRarDecay(const char *name, const char *title,
+                         RooRealVar& t, RooAbsReal& tau,
+                         const RooResolutionModel& model, DecayType type)
+  : RooDecay(name, title, t, tau, model, type)
+{
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+///
+/// The caches are not copied.
+RooRarDecay::RooRarDecay(const RooRarDecay& other, const char* name)
+  : RooDecay(other, name),
+    _convCache(other._convCache), _normCache(other._normCache)
+{
+}
+
+RooRarDecay::~RooRarDecay()
+{
+}
+
+/// \brief Evaluate from cached basis functions
+/// \return Unnormalized value
+Double_t RooRarDecay::evaluate() const
+{
+  return _convCache.evaluate(*this, _convSet);
+}
+
+/// \brief Integrate from cached basis integrals
+/// \param code Integration code
+/// \param normSet Normalization set
+/// \param rangeName Range name
+/// \return The integral
+///
+/// Only the unnormalized integral over the full range is cached,
+/// which is the one used for the normalization;
+/// others are left to RooDecay.
+Double_t RooRarDecay::analyticalIntegralWN(Int_t code,
+                                           const RooArgSet* normSet,
+                                           const char* rangeName) const
+{
+  if ((code<=0)||rangeName)
+    return RooDecay::analyticalIntegralWN(code, normSet, rangeName);
+  RooArgSet *intCoefSet, *intConvSet, *normCoefSet, *normConvSet;
+  _codeReg.retrieve(code-1, intCoefSet, intConvSet, normCoefSet, normConvSet);
+  if (normCoefSet||normConvSet)
+    return RooDecay::analyticalIntegralWN(code, normSet, rangeName);
+  return _normCache.integral(*this, _convSet, intCoefSet, intConvSet, code);
+}
+
+/// \brief Drop the caches when servers are redirected
+///
+/// The leaves of the basis functions (eg, observables attached to dataset)
+/// are looked up again at next evaluation.
+Bool_t RooRarDecay::redirectServersHook(const RooAbsCollection&
+                                        newServerList,
+                                        Bool_t mustReplaceAll,
+                                        Bool_t nameChange,
+                                        Bool_t isRecursive)
+{
+  _convCache.reset();
+  _normCache.reset();
+  return RooDecay::redirectServersHook(newServerList, mustReplaceAll,
+                                       nameChange, isRecursive);
+}
@@ -0,0 +1,330 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides sparse N-dimensional histogram Pdf
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides sparse N-dimensional histogram Pdf
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include "TMath.h"
+
+#include "RooAbsBinning.h"
+#include "RooAbsData.h"
+#include "RooAbsRealLValue.h"
+#include "RooArgList.h"
+#include "RooArgSet.h"
+
+#include "RooRarSparseHistPdf.hh"
+
+ClassImp(RooRarSparseHistPdf)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param obs The observables (RooAbsRealLValue)
+/// \param data The dataset to fill the histogram
+/// \param intOrder Interpolation order (0 or 1)
+///
+/// Events outside the binning are ignored.
+RooRarSparseHistPdf::RooRarSparseHistPdf(const char *name, const char *title,
+                                         const RooArgList& obs,
+                                         const RooAbsData& data,
+                                         Int_t intOrder)
+  : RooAbsPdf(name, title),
+    _obs("obs", "observables", this),
+    _intOrder(intOrder>0?1:0), _uniform(kTRUE), _total(0)
+{
+  Int_t nDim=obs.getSize();
+  if ((_intOrder>0)&&(nDim>16)) {
+    cout<<" W A R N I N G !"<<endl
+        <<" No interpolation for "<<nDim<<" dimensions in "<<name<<endl;
+    _intOrder=0;
+  }
+  _nBins.Set(nDim);
+  _edgeOff.Set(nDim);
+  _strides.Set(nDim);
+  RooArgList dataObs;
+  const RooArgSet *row=data.get();
+  Long64_t stride=1;
+  for (Int_t d=0; d<nDim; d++) {
+    RooAbsRealLValue *theObs=dynamic_cast<RooAbsRealLValue*>(obs.at(d));
+    RooAbsReal *dataVar=row?
+      dynamic_cast<RooAbsReal*>(row->find(obs.at(d)->GetName())):0;
+    if (!theObs||!dataVar) {
+      cout<<" Observable "<<obs.at(d)->GetName()<<" of "<<name
+          <<" must be RooAbsRealLValue in dataset "<<data.GetName()<<endl;
+      exit(-1);
+    }
+    _obs.add(*theObs);
+    dataObs.add(*dataVar);
+    const RooAbsBinning &binning=theObs->getBinning();
+    _nBins[d]=binning.numBins();
+    _edgeOff[d]=_edges.GetSize();
+    _edges.Set(_edgeOff[d]+_nBins[d]+1);
+    for (Int_t b=0; b<=_nBins[d]; b++)
+      _edges[_edgeOff[d]+b]=b<_nBins[d]?binning.binLow(b):binning.highBound();
+    if (!binning.isUniform()) _uniform=kFALSE;
+    _strides[d]=stride;
+    stride*=_nBins[d];
+  }
+  
+  // linear bin index of each event
+  Int_t nEntries=data.numEntries();
+  TArrayL64 evtIdx(nEntries);
+  TArrayD evtW(nEntries);
+  Int_t nIn(0);
+  for (Int_t i=0; i<nEntries; i++) {
+    data.get(i);
+    Long64_t idx(0);
+    for (Int_t d=0; (idx>=0)&&(d<nDim); d++) {
+      Int_t b=findBin(d, ((RooAbsReal*)dataObs.at(d))->getVal());
+      if (b<0) idx=-1;
+      else idx+=b*_strides[d];
+    }
+    if (idx<0) continue;
+    evtIdx[nIn]=idx;
+    evtW[nIn]=data.weight();
+    nIn++;
+  }
+  // merge events of same bin
+  TArrayI perm(nIn);
+  TMath::Sort(nIn, evtIdx.GetArray(), perm.GetArray(), kFALSE);
+  _binIdx.Set(nIn);
+  _binW.Set(nIn);
+  Int_t nFilled(0);
+  for (Int_t i=0; i<nIn; i++) {
+    Long64_t idx=evtIdx[perm[i]];
+    if ((0==nFilled)||(_binIdx[nFilled-1]!=idx)) {
+      _binIdx[nFilled]=idx;
+      _binW[nFilled]=0;
+      nFilled++;
+    }
+    _binW[nFilled-1]+=evtW[perm[i]];
+    _total+=evtW[perm[i]];
+  }
+  _binIdx.Set(nFilled);
+  _binW.Set(nFilled);
+  buildHash();
+  cout<<" Sparse histogram "<<name<<": "<<nFilled<<" filled bins of "
+      <<stride<<endl;
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+RooRarSparseHistPdf::RooRarSparseHistPdf(const RooRarSparseHistPdf& other,
+                                         const char* name)
+  : RooAbsPdf(other, name),
+    _obs("obs", this, other._obs),
+    _intOrder(other._intOrder), _nBins(other._nBins),
+    _edgeOff(other._edgeOff), _edges(other._edges),
+    _strides(other._strides), _uniform(other._uniform),
+    _binIdx(other._binIdx), _binW(other._binW), _hash(other._hash),
+    _total(other._total)
+{
+}
+
+RooRarSparseHistPdf::~RooRarSparseHistPdf()
+{
+}
+
+/// \brief Find bin of an observable
+/// \param d Index of the observable
+/// \param x The value
+/// \return Bin number (-1 if outside the binning)
+Int_t RooRarSparseHistPdf::findBin(Int_t d, Double_t x) const
+{
+  Int_t n=_nBins[d];
+  const Double_t *e=_edges.GetArray()+_edgeOff[d];
+  if ((x<e[0])||(x>e[n])) return -1;
+  Int_t b=TMath::BinarySearch(n+1, e, x);
+  if (b>n-1) b=n-1;
+  return b;
+}
+
+/// \brief Hash slot of a linear bin index
+/// \param idx Linear bin index
+/// \return The slot holding \p idx, or the empty slot where it would be
+Int_t RooRarSparseHistPdf::hashSlot(Long64_t idx) const
+{
+  Int_t mask=_hash.GetSize()-1;
+  ULong64_t h=((ULong64_t)idx)*0x9E3779B97F4A7C15ULL;
+  Int_t slot=(Int_t)(h>>33)&mask;
+  while ((_hash[slot]>=0)&&(_binIdx[_hash[slot]]!=idx)) slot=(slot+1)&mask;
+  return slot;
+}
+
+/// \brief Return weight of a bin
+/// \param idx Linear bin index
+/// \return The weight (0 for empty bins)
+Double_t RooRarSparseHistPdf::lookup(Long64_t idx) const
+{
+  Int_t pos=_hash[hashSlot(idx)];
+  return pos<0?0:_binW[pos];
+}
+
+/// \brief Build hash of filled bins
+///
+/// The table size is a power of two, at least twice the filled bins.
+void RooRarSparseHistPdf::buildHash()
+{
+  Int_t size=16;
+  while (size<2*_binIdx.GetSize()) size*=2;
+  _hash.Set(size);
+  _hash.Reset(-1);
+  for (Int_t i=0; i<_binIdx.GetSize(); i++) _hash[hashSlot(_binIdx[i])]=i;
+}
+
+/// \brief Evaluate the histogram density
+/// \return Bin weight over bin volume, interpolated if #_intOrder is 1
+Double_t RooRarSparseHistPdf::evaluate() const
+{
+  Int_t nDim=_obs.getSize();
+  if (0==_intOrder) {
+    Long64_t idx(0);
+    Double_t vol(1);
+    for (Int_t d=0; d<nDim; d++) {
+      Int_t b=findBin(d, ((RooAbsReal*)_obs.at(d))->getVal());
+      if (b<0) return 0;
+      idx+=b*_strides[d];
+      vol*=binWidth(d, b);
+    }
+    return lookup(idx)/vol;
+  }
+  // multilinear between bin centers, flat in the outer half bins
+  Int_t lo[16], hi[16];
+  Double_t t[16];
+  for (Int_t d=0; d<nDim; d++) {
+    Double_t x=((RooAbsReal*)_obs.at(d))->getVal();
+    Int_t b=findBin(d, x);
+    if (b<0) return 0;
+    Double_t c=binLow(d, b)+.5*binWidth(d, b);
+    lo[d]=(x<c)?b-1:b;
+    hi[d]=lo[d]+1;
+    if (lo[d]<0) {
+      lo[d]=hi[d]=0;
+      t[d]=0;
+    } else if (hi[d]>_nBins[d]-1) {
+      lo[d]=hi[d]=_nBins[d]-1;
+      t[d]=0;
+    } else {
+      Double_t cLo=binLow(d, lo[d])+.5*binWidth(d, lo[d]);
+      Double_t cHi=binLow(d, hi[d])+.5*binWidth(d, hi[d]);
+      t[d]=(x-cLo)/(cHi-cLo);
+    }
+  }
+  Double_t result(0);
+  for (Int_t corner=0; corner<(1<<nDim); corner++) {
+    Double_t w(1), vol(1);
+    Long64_t idx(0);
+    for (Int_t d=0; (w!=0)&&(d<nDim); d++) {
+      Bool_t up=(corner>>d)&1;
+      w*=up?t[d]:1-t[d];
+      Int_t b=up?hi[d]:lo[d];
+      idx+=b*_strides[d];
+      vol*=binWidth(d, b);
+    }
+    if (w!=0) result+=w*lookup(idx)/vol;
+  }
+  return result;
+}
+
+/// \brief Advertise analytical integrals
+/// \param allVars Variables to integrate
+/// \param analVars Variables integrated analytically
+/// \param rangeName Range name
+/// \return Bit mask of integrated observables (0 if none)
+///
+/// With #_intOrder 1, only the full integral over all observables
+/// with uniform binnings is provided, for which the interpolation
+/// conserves the sum of weights.
+Int_t RooRarSparseHistPdf::getAnalyticalIntegral(RooArgSet& allVars,
+                                                 RooArgSet& analVars,
+                                                 const char* rangeName) const
+{
+  Int_t nDim=_obs.getSize();
+  if (nDim>30) return 0;
+  Int_t mask(0);
+  RooArgSet matched;
+  for (Int_t d=0; d<nDim; d++) {
+    RooAbsArg *theVar=allVars.find(_obs.at(d)->GetName());
+    if (!theVar) continue;
+    mask|=1<<d;
+    matched.add(*theVar);
+  }
+  if (!mask) return 0;
+  if ((_intOrder>0)&&(rangeName||!_uniform||(mask!=(1<<nDim)-1))) return 0;
+  analVars.add(matched);
+  return mask;
+}
+
+/// \brief Compute analytical integrals
+/// \param code Bit mask of integrated observables
+/// \param rangeName Range name
+/// \return The integral
+///
+/// Only the filled bins are visited:
+/// the fraction of each bin within the range of integrated observables,
+/// and the bin of the other observables, are taken into account.
+Double_t RooRarSparseHistPdf::analyticalIntegral(Int_t code,
+                                                 const char* rangeName) const
+{
+  Int_t nDim=_obs.getSize();
+  if ((_intOrder>0)||(!rangeName&&(code==(1<<nDim)-1))) return _total;
+  TArrayD rLo(nDim), rHi(nDim);
+  TArrayI curBin(nDim);
+  Double_t curVol(1);
+  Bool_t fullRange(kTRUE);
+  for (Int_t d=0; d<nDim; d++) {
+    RooAbsRealLValue *theObs=(RooAbsRealLValue*)_obs.at(d);
+    if ((code>>d)&1) {
+      rLo[d]=theObs->getMin(rangeName);
+      rHi[d]=theObs->getMax(rangeName);
+      Double_t eLo=_edges[_edgeOff[d]];
+      Double_t eHi=_edges[_edgeOff[d]+_nBins[d]];
+      if ((rLo[d]>eLo)||(rHi[d]<eHi)) fullRange=kFALSE;
+    } else {
+      curBin[d]=findBin(d, theObs->getVal());
+      if (curBin[d]<0) return 0;
+      curVol*=binWidth(d, curBin[d]);
+      fullRange=kFALSE;
+    }
+  }
+  if (fullRange) return _total;
+  Double_t result(0);
+  for (Int_t i=0; i<_binIdx.GetSize(); i++) {
+    Long64_t idx=_binIdx[i];
+    Double_t frac(1);
+    for (Int_t d=0; (frac>0)&&(d<nDim); d++) {
+      Int_t b=(Int_t)((idx/_strides[d])%_nBins[d]);
+      if (!((code>>d)&1)) {
+        if (b!=curBin[d]) frac=0;
+        continue;
+      }
+      Double_t lo=binLow(d, b);
+      Double_t width=binWidth(d, b);
+      Double_t oLo=rLo[d]>lo?rLo[d]:lo;
+      Double_t oHi=rHi[d]<lo+width?rHi[d]:lo+width;
+      frac*=(oHi>oLo)?(oHi-oLo)/width:0;
+    }
+    result+=frac*_binW[i];
+  }
+  return result/curVol;
+}
@@ -0,0 +1,109 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides ParametricStep Pdf with inverse-CDF generator
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides ParametricStep Pdf with inverse-CDF generator
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+
+#include "RooArgList.h"
+#include "RooRealVar.h"
+
+#include "RooRarStepFunction.hh"
+
+ClassImp(RooRarStepFunction)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param x The observable
+/// \param coefList Heights of the first nBins-1 bins
+/// \param limits Bin limits
+/// \param nBins Number of bins
+RooRarStepFunction::RooRarStepFunction(const char *name, const char *title,
+                                       RooAbsReal& x,
+                                       const RooArgList& coefList,
+                                       TArrayD& limits, Int_t nBins)
+  : RooParametricStepFunction(name, title, x, coefList, limits, nBins)
+{
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+///
+/// The cumulative table is copied, so clones made for generation
+/// do not rebuild it for the same coefficients.
+RooRarStepFunction::RooRarStepFunction(const RooRarStepFunction& other,
+                                       const char* name)
+  : RooParametricStepFunction(other, name),
+    _genTable(other._genTable)
+{
+}
+
+RooRarStepFunction::~RooRarStepFunction()
+{
+}
+
+/// \brief Generator code
+/// \return 1 if x can be generated directly, 0 otherwise
+Int_t RooRarStepFunction::getGenerator(const RooArgSet& directVars,
+                                       RooArgSet &generateVars,
+                                       Bool_t /* staticInitOK */) const
+{
+  if (matchArgs(directVars, generateVars, _x)) return 1;
+  return 0;
+}
+
+/// \brief Build the cumulative table
+/// \param code Generator code
+///
+/// The bin integrals are the heights times the bin widths
+/// for the first nBins-1 bins, and the rest of the unit
+/// normalization for the last bin.
+/// The table is only rebuilt if the coefficients changed.
+void RooRarStepFunction::initGenerator(Int_t code)
+{
+  assert(1==code);
+  TArrayD coefs(_nBins>0 ? _nBins-1 : 0);
+  for (Int_t i=0; i<coefs.GetSize(); i++)
+    coefs[i]=((RooAbsReal*)_coefList.at(i))->getVal();
+  if (_genTable.isUpToDate(coefs)) return;
+  TArrayD binInts(_nBins);
+  Double_t sum(0);
+  for (Int_t i=0; i<_nBins-1; i++) {
+    binInts[i]=coefs[i]*(_limits[i+1]-_limits[i]);
+    sum+=binInts[i];
+  }
+  if (_nBins>0) binInts[_nBins-1]=1-sum;
+  _genTable.setBins(_limits, binInts);
+}
+
+/// \brief Generate x from the inverted cumulative table
+/// \param code Generator code
+void RooRarStepFunction::generateEvent(Int_t code)
+{
+  assert(1==code);
+  Double_t min(_x.min()), max(_x.max());
+  if (min<_limits[0]) min=_limits[0];
+  if (max>_limits[_nBins]) max=_limits[_nBins];
+  _x=_genTable.generate(min, max);
+}
@@ -0,0 +1,382 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides Voigtian Pdf with rational Faddeeva kernel
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides Voigtian Pdf with rational Faddeeva kernel
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include "TMath.h"
+
+#include "RooRealVar.h"
+
+#include "RooRarVoigtian.hh"
+
+ClassImp(RooRarVoigtian)
+  ;
+
+// shape modes
+enum {flatMode=0, bwMode, gaussMode, voigtMode};
+
+// Weideman's rational approximation
+// w(z) = 2 p(Z)/(L-iz)^2 + 1/sqrt(pi)/(L-iz), Z=(L+iz)/(L-iz),
+// J.A.C. Weideman, SIAM J. Numer. Anal. 31 (1994) 1497
+static const Int_t nLoTerms=24; // relative precision ~3e-4
+static const Int_t nHiTerms=32; // relative precision ~3e-7
+// |u|+a beyond which the continued fraction is used
+static const Double_t cfRadius=8;
+
+/// \brief Fill coefficients of Weideman's approximation
+/// \param N Number of terms
+/// \param coefs Coefficients of Z^n
+/// \return Parameter L
+static Double_t weidemanCoefs(Int_t N, Double_t *coefs)
+{
+  Int_t M=2*N, M2=2*M;
+  Double_t L=sqrt(N/sqrt(2.));
+  // f(t)=exp(-t^2)(L^2+t^2) at t=L tan(theta/2), fftshift'ed
+  Double_t *f=new Double_t[M2];
+  for (Int_t i=0; i<M2; i++) {
+    Int_t k=(i+M)%M2-M;
+    if (-M==k) {
+      f[i]=0;
+    } else {
+      Double_t t=L*tan(k*TMath::Pi()/M/2);
+      f[i]=exp(-t*t)*(L*L+t*t);
+    }
+  }
+  // real part of its DFT
+  for (Int_t n=0; n<N; n++) {
+    Double_t sum(0);
+    for (Int_t i=0; i<M2; i++) sum+=f[i]*cos(2*TMath::Pi()*i*(n+1)/M2);
+    coefs[n]=sum/M2;
+  }
+  delete [] f;
+  return L;
+}
+
+/// \brief Real part of Faddeeva function, rational approximation
+/// \param u Real part of z
+/// \param a Imaginary part of z (>=0)
+/// \param N Number of terms of the rational approximation
+/// \param coefs Its coefficients
+/// \param L Its parameter
+/// \return Re w(u+ia)
+static inline Double_t faddeevaReRat(Double_t u, Double_t a, Int_t N,
+                                     const Double_t *coefs, Double_t L)
+{
+  // q=1/(L-iz), Z=(L+iz)q
+  Double_t lpa=L+a;
+  Double_t den=1./(lpa*lpa+u*u);
+  Double_t qr=lpa*den, qi=u*den;
+  Double_t zr=(L*L-a*a-u*u)*den, zi=2*L*u*den;
+  Double_t pr=coefs[N-1], pi=0;
+  for (Int_t n=N-2; n>=0; n--) {
+    Double_t tr=pr*zr-pi*zi+coefs[n];
+    pi=pr*zi+pi*zr;
+    pr=tr;
+  }
+  Double_t q2r=qr*qr-qi*qi, q2i=2*qr*qi;
+  return 2*(pr*q2r-pi*q2i)+qr/sqrt(TMath::Pi());
+}
+
+/// \brief Real part of Faddeeva function, continued fraction
+/// \param u Real part of z
+/// \param a Imaginary part of z (>=0)
+/// \param nCF Number of terms of the continued fraction
+/// \return Re w(u+ia)
+static inline Double_t faddeevaReCF(Double_t u, Double_t a, Int_t nCF)
+{
+  // Laplace continued fraction, w=i/sqrt(pi)/t
+  Double_t tr=u, ti=a;
+  for (Int_t k=nCF; k>=1; k--) {
+    Double_t tden=.5*k/(tr*tr+ti*ti);
+    Double_t ttr=u-tr*tden;
+    ti=a+ti*tden;
+    tr=ttr;
+  }
+  return ti/(tr*tr+ti*ti)/sqrt(TMath::Pi());
+}
+
+/// \brief Real part of Faddeeva function for one point, branch-free
+/// \param u Real part of z
+/// \param a Imaginary part of z (>=0)
+/// \param N Number of terms of the rational approximation
+/// \param coefs Its coefficients
+/// \param L Its parameter
+/// \param nCF Number of terms of the continued fraction
+/// \return Re w(u+ia)
+///
+/// Both approximations are evaluated and the result is selected
+/// at the end, so batch loops over it have no branches.
+static inline Double_t faddeevaReKernel(Double_t u, Double_t a, Int_t N,
+                                        const Double_t *coefs, Double_t L,
+                                        Int_t nCF)
+{
+  Double_t wRat=faddeevaReRat(u, a, N, coefs, L);
+  Double_t wCF=faddeevaReCF(u, a, nCF);
+  return (fabs(u)+a<cfRadius) ? wRat : wCF;
+}
+
+/// \brief Return kernel setup for a precision
+/// \param precision Relative precision
+/// \param N Number of terms of the rational approximation
+/// \param L Its parameter
+/// \param nCF Number of terms of the continued fraction
+/// \return Its coefficients
+static const Double_t *faddeevaSetup(Double_t precision, Int_t &N,
+                                     Double_t &L, Int_t &nCF)
+{
+  static Double_t loCoefs[nLoTerms], hiCoefs[nHiTerms];
+  static Double_t loL=weidemanCoefs(nLoTerms, loCoefs);
+  static Double_t hiL=weidemanCoefs(nHiTerms, hiCoefs);
+  if (precision>=3e-4) {
+    N=nLoTerms;
+    L=loL;
+    nCF=4;
+    return loCoefs;
+  }
+  N=nHiTerms;
+  L=hiL;
+  nCF=8;
+  return hiCoefs;
+}
+
+/// \brief Real part of Faddeeva function
+/// \param u Real part of z
+/// \param a Imaginary part of z (>=0)
+/// \param precision Relative precision
+/// \return Re w(u+ia)
+///
+/// Only the approximation valid at \p u+i\p a is evaluated.
+Double_t RooRarVoigtian::faddeevaRe(Double_t u, Double_t a,
+                                    Double_t precision)
+{
+  Int_t N, nCF;
+  Double_t L;
+  const Double_t *coefs=faddeevaSetup(precision, N, L, nCF);
+  if (fabs(u)+a<cfRadius) return faddeevaReRat(u, a, N, coefs, L);
+  return faddeevaReCF(u, a, nCF);
+}
+
+/// \brief Real part of Faddeeva function for a batch of points
+/// \param n Number of points
+/// \param u Real parts of z
+/// \param a Imaginary parts of z (>=0)
+/// \param re Output Re w(u+ia)
+/// \param precision Relative precision
+///
+/// It uses the branch-free kernel.
+void RooRarVoigtian::faddeevaRe(Int_t n, const Double_t *u,
+                                const Double_t *a, Double_t *re,
+                                Double_t precision)
+{
+  Int_t N, nCF;
+  Double_t L;
+  const Double_t *coefs=faddeevaSetup(precision, N, L, nCF);
+  for (Int_t i=0; i<n; i++)
+    re[i]=faddeevaReKernel(u[i], a[i], N, coefs, L, nCF);
+}
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param _x The observable
+/// \param _mean Mean of Breit-Wigner
+/// \param _width FWHM of Breit-Wigner
+/// \param _sigma Sigma of Gaussian
+/// \param precision Relative precision
+RooRarVoigtian::RooRarVoigtian(const char *name, const char *title,
+                               RooAbsReal& _x, RooAbsReal& _mean,
+                               RooAbsReal& _width, RooAbsReal& _sigma,
+                               Double_t precision)
+  : RooAbsPdf(name, title),
+    x("x", "Dependent", this, _x),
+    mean("mean", "Mean", this, _mean),
+    width("width", "Breit-Wigner Width", this, _width),
+    sigma("sigma", "Gauss Width", this, _sigma),
+    _precision(precision)
+{
+}
+
+/// \brief Copy ctor
+RooRarVoigtian::RooRarVoigtian(const RooRarVoigtian& other, const char* name)
+  : RooAbsPdf(other, name),
+    x("x", this, other.x),
+    mean("mean", this, other.mean),
+    width("width", this, other.width),
+    sigma("sigma", this, other.sigma),
+    _precision(other._precision)
+{
+}
+
+RooRarVoigtian::~RooRarVoigtian()
+{
+}
+
+/// \brief Print the precision with the args
+/// \param os The output stream
+///
+/// With the servers, it gives the full state of the pdf
+/// (the shape mode follows from the params and the precision).
+void RooRarVoigtian::printMetaArgs(ostream &os) const
+{
+  os<<"precision="<<_precision<<" ";
+}
+
+/// \brief Choose shape for the current params
+/// \param s Sigma of Gaussian
+/// \param w FWHM of Breit-Wigner
+/// \return Shape mode
+///
+/// Breit-Wigner if the Gaussian correction (sigma/gamma)^2
+/// is below the precision,
+/// Gaussian if the Breit-Wigner correction at the peak and
+/// its tail at the far end of the range of x are below the precision.
+Int_t RooRarVoigtian::getShapeMode(Double_t s, Double_t w) const
+{
+  Double_t g=.5*w;
+  if ((0==s)&&(0==g)) return flatMode;
+  if ((0==s)||(s*s<_precision*g*g)) return bwMode;
+  if (0==g) return gaussMode;
+  if (g/s*sqrt(2./TMath::Pi())>=_precision) return voigtMode;
+  Double_t dMax=TMath::Max(fabs(x.min()-mean), fabs(x.max()-mean));
+  if (dMax<s) return gaussMode;
+  // (g/pi)/d^2 < precision * exp(-d^2/2s^2)/(s sqrt(2pi))
+  Double_t logTail=log(g/TMath::Pi()/(dMax*dMax));
+  Double_t logGauss=-.5*dMax*dMax/(s*s)-log(s*sqrt(2*TMath::Pi()));
+  if (logTail<log(_precision)+logGauss) return gaussMode;
+  return voigtMode;
+}
+
+/// \brief Return unit normalized shape
+/// \param xval Value of x
+/// \param mode Shape mode
+/// \param s Sigma of Gaussian
+/// \param w FWHM of Breit-Wigner
+Double_t RooRarVoigtian::evalAt(Double_t xval, Int_t mode,
+                                Double_t s, Double_t w) const
+{
+  Double_t arg=xval-mean;
+  Double_t g=.5*w;
+  switch (mode) {
+  case flatMode:
+    return 1;
+  case bwMode:
+    return g/TMath::Pi()/(arg*arg+g*g);
+  case gaussMode:
+    return exp(-.5*arg*arg/(s*s))/(s*sqrt(2*TMath::Pi()));
+  }
+  Double_t c=1./(sqrt(2.)*s);
+  return c*faddeevaRe(c*arg, c*g, _precision)/sqrt(TMath::Pi());
+}
+
+Double_t RooRarVoigtian::evaluate() const
+{
+  Double_t s=fabs(sigma);
+  Double_t w=fabs(width);
+  return evalAt(x, getShapeMode(s, w), s, w);
+}
+
+/// \brief Claim integral over x
+Int_t RooRarVoigtian::getAnalyticalIntegral(RooArgSet& allVars,
+                                            RooArgSet& analVars,
+                                            const char* /*rangeName*/) const
+{
+  if (matchArgs(allVars, analVars, x)) return 1;
+  return 0;
+}
+
+/// \brief Return integral over x in a named range
+/// \param code Integral code
+/// \param rangeName Range name
+///
+/// Breit-Wigner, Gaussian and flat shapes are integrated analytically.
+/// The Voigtian is integrated with 8-point Gauss-Legendre quadrature
+/// over panels of half of \p sigma+gamma within \p K(sigma+gamma)
+/// of the mean, evaluated with the batch kernel,
+/// and outside with the Breit-Wigner plus its second order
+/// Gaussian correction (sigma^2/2 BW''),
+/// with \p K chosen so that the next order is below the precision.
+Double_t RooRarVoigtian::analyticalIntegral(Int_t code,
+                                            const char* rangeName) const
+{
+  assert(1==code);
+  static const Double_t glx[8]={
+    -0.9602898564975363, -0.7966664774136267, -0.5255324099163290,
+    -0.1834346424956498,  0.1834346424956498,  0.5255324099163290,
+     0.7966664774136267,  0.9602898564975363};
+  static const Double_t glw[8]={
+    0.1012285362903763, 0.2223810344533745, 0.3137066458778873,
+    0.3626837833783620, 0.3626837833783620, 0.3137066458778873,
+    0.2223810344533745, 0.1012285362903763};
+  Double_t s=fabs(sigma);
+  Double_t w=fabs(width);
+  Double_t g=.5*w;
+  Double_t xMin=x.min(rangeName), xMax=x.max(rangeName);
+  Int_t mode=getShapeMode(s, w);
+  switch (mode) {
+  case flatMode:
+    return xMax-xMin;
+  case bwMode:
+    return (atan((xMax-mean)/g)-atan((xMin-mean)/g))/TMath::Pi();
+  case gaussMode:
+    return .5*(TMath::Erf((xMax-mean)/(sqrt(2.)*s))-
+               TMath::Erf((xMin-mean)/(sqrt(2.)*s)));
+  }
+  Double_t scale=s+g;
+  Double_t K=10*pow(TMath::Max(1e-6/_precision, 1.), .2);
+  Double_t lo=mean-K*scale, hi=mean+K*scale;
+  Double_t retVal(0);
+  // core
+  Double_t cLo=TMath::Max(xMin, lo), cHi=TMath::Min(xMax, hi);
+  if (cHi>cLo) {
+    Int_t nPanels=(Int_t)ceil((cHi-cLo)/(.5*scale));
+    Double_t h=(cHi-cLo)/nPanels;
+    Int_t nPoints=8*nPanels;
+    Double_t *u=new Double_t[nPoints];
+    Double_t *a=new Double_t[nPoints];
+    Double_t *re=new Double_t[nPoints];
+    Double_t c=1./(sqrt(2.)*s);
+    for (Int_t p=0; p<nPanels; p++) {
+      for (Int_t j=0; j<8; j++) {
+        u[8*p+j]=c*(cLo+(p+.5+.5*glx[j])*h-mean);
+        a[8*p+j]=c*g;
+      }
+    }
+    faddeevaRe(nPoints, u, a, re, _precision);
+    for (Int_t i=0; i<nPoints; i++) retVal+=glw[i%8]*re[i];
+    retVal*=.5*h*c/sqrt(TMath::Pi());
+    delete [] u;
+    delete [] a;
+    delete [] re;
+  }
+  // tails: BW + s^2/2 BW'', with BW'(d)=-(g/pi) 2d/(d^2+g^2)^2
+  Double_t tailLo[2]={xMin, TMath::Min(xMax, lo)};
+  Double_t tailHi[2]={TMath::Max(xMin, hi), xMax};
+  for (Int_t t=0; t<2; t++) {
+    Double_t from=(0==t) ? tailLo[0] : tailHi[0];
+    Double_t to=(0==t) ? tailLo[1] : tailHi[1];
+    if (to<=from) continue;
+    Double_t d1=from-mean, d2=to-mean;
+    Double_t bwp1=-g/TMath::Pi()*2*d1/((d1*d1+g*g)*(d1*d1+g*g));
+    Double_t bwp2=-g/TMath::Pi()*2*d2/((d2*d2+g*g)*(d2*d2+g*g));
+    retVal+=(atan(d2/g)-atan(d1/g))/TMath::Pi()+.5*s*s*(bwp2-bwp1);
+  }
+  return retVal;
+}
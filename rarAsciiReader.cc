@@ -0,0 +1,352 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides multi-threaded reader of ascii dataset files
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides multi-threaded reader of ascii dataset files
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TObjString.h"
+#include "TObjArray.h"
+
+#include "RooAbsCategory.h"
+#include "RooArgSet.h"
+#include "RooCatType.h"
+#include "RooCategory.h"
+#include "RooDataSet.h"
+#include "RooRealVar.h"
+
+#include "rarAsciiReader.hh"
+#include "rarFingerprint.hh"
+
+using namespace std;
+
+ClassImp(rarAsciiReader)
+  ;
+
+/// \brief A line-aligned chunk of a file and its parsed columns
+struct rarAsciiChunk {
+  const char *beg; ///< First char
+  const char *end; ///< One past the last char
+  Int_t nVars; ///< Number of fields
+  const RooRealVar * const *reals; ///< Real vars (null for category)
+  const map<string, Int_t> *labels; ///< Category labels -> indices
+  const set<Int_t> *indices; ///< Category indices
+  vector<vector<Double_t> > cols; ///< Parsed columns
+  Int_t nSkipped; ///< Number of lines skipped
+};
+
+/// \brief Parse one chunk (thread function)
+/// \param arg The chunk (rarAsciiChunk)
+/// \return Null
+static void *rarAsciiParse(void *arg)
+{
+  rarAsciiChunk &chunk=*(rarAsciiChunk*)arg;
+  chunk.cols.resize(chunk.nVars);
+  chunk.nSkipped=0;
+  vector<Double_t> row(chunk.nVars);
+  string token;
+  const char *p=chunk.beg;
+  while (p<chunk.end) {
+    const char *eol=(const char*)memchr(p, '\n', chunk.end-p);
+    if (!eol) eol=chunk.end;
+    // skip comment lines, as RooDataSet::read
+    const char *first=p;
+    while ((first<eol)&&isspace((unsigned char)*first)) first++;
+    if ((first<eol)&&('#'==*first)) {
+      p=eol+1;
+      continue;
+    }
+    // chop comments
+    const char *lineEnd=eol;
+    for (const char *c=p; c+1<eol; c++)
+      if (('/'==c[0])&&('/'==c[1])) {
+        lineEnd=c;
+        break;
+      }
+    // parse fields
+    Int_t nFields(0);
+    Bool_t isBlank(kTRUE), isBad(kFALSE);
+    const char *c=p;
+    while ((nFields<chunk.nVars)&&!isBad) {
+      while ((c<lineEnd)&&isspace((unsigned char)*c)) c++;
+      if (c>=lineEnd) break;
+      isBlank=kFALSE;
+      const char *tokEnd=c;
+      while ((tokEnd<lineEnd)&&!isspace((unsigned char)*tokEnd)) tokEnd++;
+      token.assign(c, tokEnd-c);
+      c=tokEnd;
+      const RooRealVar *theVar=chunk.reals[nFields];
+      if (theVar) {
+        char *numEnd(0);
+        Double_t val=strtod(token.c_str(), &numEnd);
+        if ((numEnd!=token.c_str()+token.length())||
+            !theVar->isValidReal(val)) isBad=kTRUE;
+        row[nFields]=val;
+      } else {
+        const unsigned char t0=token[0];
+        if (isdigit(t0)||('-'==t0)||('+'==t0)) {
+          Int_t idx=atoi(token.c_str());
+          if (!chunk.indices[nFields].count(idx)) isBad=kTRUE;
+          row[nFields]=idx;
+        } else {
+          map<string, Int_t>::const_iterator it=
+            chunk.labels[nFields].find(token);
+          if (it==chunk.labels[nFields].end()) isBad=kTRUE;
+          else row[nFields]=it->second;
+        }
+      }
+      nFields++;
+    }
+    if (!isBlank) {
+      if (isBad||(nFields<chunk.nVars)) chunk.nSkipped++;
+      else for (Int_t i=0; i<chunk.nVars; i++)
+             chunk.cols[i].push_back(row[i]);
+    }
+    p=eol+1;
+  }
+
+  return 0;
+}
+
+/// \brief Default ctor
+/// \param vars Variables of the fields, in field order
+/// \param nThreads Number of parsing threads
+rarAsciiReader::rarAsciiReader(const RooArgSet &vars, Int_t nThreads)
+  : TObject(), _vars(vars), _nThreads(nThreads),
+    _wgtVarName(""), _fingerprint("")
+{
+  if (_nThreads<1) _nThreads=1;
+}
+
+rarAsciiReader::~rarAsciiReader()
+{
+}
+
+/// \brief Set derived columns to evaluate while reading
+/// \param addOns Derived columns (of the field variables)
+/// \return False if they can not be evaluated by this reader
+///
+/// Only real and category valued columns are supported;
+/// if any other is found, no column is set,
+/// and the caller should add them to the dataset itself.
+Bool_t rarAsciiReader::setAddOns(const RooArgSet &addOns)
+{
+  RooArgList addOnList(addOns);
+  for (Int_t i=0; i<addOnList.getSize(); i++)
+    if (!dynamic_cast<RooAbsReal*>(addOnList.at(i))&&
+        !dynamic_cast<RooAbsCategory*>(addOnList.at(i))) return kFALSE;
+  _addOns.removeAll();
+  _addOnCols.removeAll();
+  for (Int_t i=0; i<addOnList.getSize(); i++) {
+    _addOns.add(*addOnList.at(i));
+    _addOnCols.addOwned(*addOnList.at(i)->createFundamental());
+  }
+
+  return kTRUE;
+}
+
+/// \brief Read in dataset from ascii files
+/// \param fileList Comma separated list of files
+/// \param commonPath Dir of the files
+/// \return The dataset, or null if it can not be read in by this reader
+///
+/// The dataset is named and titled as by RooDataSet::read.
+/// Its fingerprint is kept for #getFingerprint.
+RooDataSet *rarAsciiReader::read(const char *fileList, const char *commonPath)
+{
+  _fingerprint="";
+  // only fundamental real and category vars
+  for (Int_t i=0; i<_vars.getSize(); i++) {
+    TString className=_vars.at(i)->ClassName();
+    if (("RooRealVar"!=className)&&("RooCategory"!=className)) return 0;
+  }
+  RooArgSet theVars(_vars);
+  theVars.add(_addOnCols);
+  RooDataSet *data=new RooDataSet("dataset", fileList, theVars);
+  rarFingerprint fingerprint(RooArgList(theVars), _wgtVarName);
+  // same file names as RooDataSet::read
+  TObjArray *files=TString(fileList).Tokenize(", ");
+  for (Int_t i=0; i<files->GetEntries(); i++) {
+    TString fileName=((TObjString*)files->At(i))->String();
+    if (commonPath) fileName=TString(commonPath)+fileName;
+    if (!readFile(fileName, *data, fingerprint)) {
+      delete files;
+      delete data;
+      return 0;
+    }
+  }
+  delete files;
+  _fingerprint=fingerprint.getFingerprint();
+
+  return data;
+}
+
+/// \brief Read in events of one file
+/// \param fileName The file
+/// \param data The dataset to add events to
+/// \param fingerprint The fingerprint to add events to
+/// \return False if the file can not be mapped
+Bool_t rarAsciiReader::readFile(const char *fileName, RooDataSet &data,
+                                rarFingerprint &fingerprint)
+{
+  int fd=open(fileName, O_RDONLY);
+  if (fd<0) {
+    cout<<" Can not open "<<fileName<<endl;
+    return kFALSE;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat)) {
+    close(fd);
+    return kFALSE;
+  }
+  size_t fileSize=fileStat.st_size;
+  if (fileSize<=0) {
+    close(fd);
+    return kTRUE;
+  }
+  void *addr=mmap(0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED==addr) {
+    cout<<" Can not map "<<fileName<<endl;
+    return kFALSE;
+  }
+  const char *buf=(const char*)addr;
+
+  // field descriptions
+  Int_t nVars=_vars.getSize();
+  vector<const RooRealVar*> reals(nVars, (const RooRealVar*)0);
+  vector<map<string, Int_t> > labels(nVars);
+  vector<set<Int_t> > indices(nVars);
+  for (Int_t i=0; i<nVars; i++) {
+    reals[i]=dynamic_cast<const RooRealVar*>(_vars.at(i));
+    RooCategory *theCat=dynamic_cast<RooCategory*>(_vars.at(i));
+    if (!theCat) continue;
+    TIterator *typeIter=theCat->typeIterator();
+    RooCatType *theType(0);
+    while ((theType=(RooCatType*)typeIter->Next())) {
+      labels[i][theType->GetName()]=theType->getVal();
+      indices[i].insert(theType->getVal());
+    }
+    delete typeIter;
+  }
+
+  // line-aligned chunks
+  Int_t nChunks=_nThreads;
+  if (fileSize<(size_t)nChunks*65536) nChunks=fileSize/65536+1;
+  vector<rarAsciiChunk> chunks(nChunks);
+  const char *chunkBeg=buf;
+  for (Int_t i=0; i<nChunks; i++) {
+    const char *chunkEnd=buf+fileSize;
+    if (i<nChunks-1) {
+      chunkEnd=buf+fileSize*(i+1)/nChunks;
+      if (chunkEnd<chunkBeg) chunkEnd=chunkBeg;
+      const char *eol=(const char*)memchr(chunkEnd, '\n', buf+fileSize-chunkEnd);
+      chunkEnd=eol?eol+1:buf+fileSize;
+    }
+    chunks[i].beg=chunkBeg;
+    chunks[i].end=chunkEnd;
+    chunks[i].nVars=nVars;
+    chunks[i].reals=nVars>0?&reals[0]:0;
+    chunks[i].labels=nVars>0?&labels[0]:0;
+    chunks[i].indices=nVars>0?&indices[0]:0;
+    chunkBeg=chunkEnd;
+  }
+
+  // parse chunks in parallel
+  vector<pthread_t> threads(nChunks);
+  vector<Bool_t> started(nChunks, kFALSE);
+  for (Int_t i=1; i<nChunks; i++)
+    started[i]=!pthread_create(&threads[i], 0, rarAsciiParse, &chunks[i]);
+  rarAsciiParse(&chunks[0]);
+  for (Int_t i=1; i<nChunks; i++) {
+    if (started[i]) pthread_join(threads[i], 0);
+    else rarAsciiParse(&chunks[i]);
+  }
+  munmap(addr, fileSize);
+
+  // derived columns, bound to their fundamental columns
+  Int_t nAddOns=_addOns.getSize();
+  vector<RooAbsReal*> addOnReals(nAddOns, (RooAbsReal*)0);
+  vector<RooAbsCategory*> addOnCats(nAddOns, (RooAbsCategory*)0);
+  vector<RooAbsArg*> addOnCols(nAddOns, (RooAbsArg*)0);
+  for (Int_t k=0; k<nAddOns; k++) {
+    addOnReals[k]=dynamic_cast<RooAbsReal*>(_addOns.at(k));
+    addOnCats[k]=dynamic_cast<RooAbsCategory*>(_addOns.at(k));
+    addOnCols[k]=_addOnCols.find(_addOns.at(k)->GetName());
+  }
+
+  // assemble events in file order
+  RooArgSet theVars(_vars);
+  theVars.add(_addOnCols);
+  RooArgList cols(theVars);
+  Int_t nCols=cols.getSize();
+  vector<RooAbsReal*> colReals(nCols, (RooAbsReal*)0);
+  vector<RooAbsCategory*> colCats(nCols, (RooAbsCategory*)0);
+  for (Int_t k=0; k<nCols; k++) {
+    colReals[k]=dynamic_cast<RooAbsReal*>(cols.at(k));
+    if (!colReals[k]) colCats[k]=dynamic_cast<RooAbsCategory*>(cols.at(k));
+  }
+  vector<Double_t> colVals(nCols+1);
+  vector<RooRealVar*> fieldReals(nVars, (RooRealVar*)0);
+  vector<RooCategory*> fieldCats(nVars, (RooCategory*)0);
+  for (Int_t k=0; k<nVars; k++) {
+    if (reals[k]) fieldReals[k]=(RooRealVar*)_vars.at(k);
+    else fieldCats[k]=(RooCategory*)_vars.at(k);
+  }
+  Int_t nRead(0), nSkipped(0);
+  for (Int_t i=0; i<nChunks; i++) {
+    Int_t nRows=(nVars>0)?chunks[i].cols[0].size():0;
+    for (Int_t j=0; j<nRows; j++) {
+      for (Int_t k=0; k<nVars; k++) {
+        if (fieldReals[k]) fieldReals[k]->setVal(chunks[i].cols[k][j]);
+        else fieldCats[k]->setIndex((Int_t)chunks[i].cols[k][j]);
+      }
+      for (Int_t k=0; k<nAddOns; k++) {
+        if (addOnReals[k])
+          ((RooRealVar*)addOnCols[k])->setVal(addOnReals[k]->getVal());
+        else
+          ((RooCategory*)addOnCols[k])->setIndex(addOnCats[k]->getIndex());
+      }
+      data.add(theVars);
+      for (Int_t k=0; k<nCols; k++)
+        colVals[k]=colReals[k]?colReals[k]->getVal():colCats[k]->getIndex();
+      fingerprint.addRow(&colVals[0]);
+    }
+    nRead+=nRows;
+    nSkipped+=chunks[i].nSkipped;
+  }
+  cout<<"rarAsciiReader::read: read "<<nRead<<" events from file "
+      <<fileName<<" with "<<nChunks<<" threads"
+      <<" (ignored "<<nSkipped<<" out of range events)"<<endl;
+
+  return kTRUE;
+}
@@ -22,6 +22,7 @@
 #include "Riostream.h"
 #include <fstream>
 #include <sstream>
+#include <stdlib.h>
 using namespace std;
 
 #include "TArrayI.h"
@@ -47,7 +48,9 @@ using namespace std;
 using namespace RooFit;
 
 #include "rarBasePdf.hh"
+#include "rarFitDriver.hh"
 #include "rarMLFitter.hh"
+#include "rarNormCachePdf.hh"
 
 ClassImp(rarBasePdf)
   ;
@@ -838,6 +841,118 @@ TString rarBasePdf::getCorrCoefName(const TString pn1, const TString pn2) const
   return corrName;
 }
 
+/// \brief Configure the fit driver
+/// \param fitDriver The fit driver to configure
+///
+/// It reads the fit driver configs (see rarFitDriver)
+/// from the action section,
+/// or from the master section if they are not set in the action section.
+void rarBasePdf::setupFitDriver(rarFitDriver &fitDriver)
+{
+  TString defStr=readConfStr("fitMinimizer", "", getMasterSec());
+  rarStrParser fitMinimizerParser=readConfStr("fitMinimizer", defStr, _runSec);
+  if (fitMinimizerParser.nArgs()>0)
+    fitDriver.setMinimizer(fitMinimizerParser[0],
+                           fitMinimizerParser.nArgs()>1 ?
+                           fitMinimizerParser[1] : TString(""));
+  defStr=readConfStr("fitStrategy", "-1", getMasterSec());
+  fitDriver.setStrategy(atoi(readConfStr("fitStrategy", defStr, _runSec)));
+  defStr=readConfStr("fitRetries", "0", getMasterSec());
+  rarStrParser fitRetriesParser=readConfStr("fitRetries", defStr, _runSec);
+  fitDriver.setRetries(atoi(fitRetriesParser[0]),
+                       fitRetriesParser.nArgs()>1 ?
+                       atof(fitRetriesParser[1]) : 0.);
+  defStr=readConfStr("fitMinCovQual", "3", getMasterSec());
+  fitDriver.setMinCovQual(atoi(readConfStr("fitMinCovQual", defStr, _runSec)));
+  defStr=readConfStr("fitMaxCalls", "0", getMasterSec());
+  fitDriver.setMaxCalls(atoi(readConfStr("fitMaxCalls", defStr, _runSec)));
+  defStr=readConfStr("fitMaxTime", "0", getMasterSec());
+  fitDriver.setMaxTime(atof(readConfStr("fitMaxTime", defStr, _runSec)));
+  defStr=readConfStr("fitCache", "no", getMasterSec());
+  TString fitCache=readConfStr("fitCache", defStr, _runSec);
+  if ("yes"==fitCache) {
+    fitCache=getDefResultDir();
+    if (getFitter()&&(""!=getFitter()->getResultDir()))
+      fitCache=getFitter()->getResultDir();
+    fitCache+="/fitCache";
+  }
+  if (!fitCache.BeginsWith("no")) fitDriver.setCacheDir(fitCache);
+  defStr=readConfStr("fitConstOpt", "2", getMasterSec());
+  fitDriver.setConstOpt(atoi(readConfStr("fitConstOpt", defStr, _runSec)));
+}
+
+/// \brief Return the result dir as set by rarFit
+/// \return \p RESULTDIR from environment, or \p results if not set
+///
+/// Pdfs are built before the result dir of the final rarMLFitter is set,
+/// so config defaults under the result dir read during construction
+/// use this instead of rarMLFitter::getResultDir.
+TString rarBasePdf::getDefResultDir()
+{
+  TString resultDir="results";
+  if (getenv("RESULTDIR")) resultDir=getenv("RESULTDIR");
+  return resultDir;
+}
+
+/// \brief Wrap pdf with interpolated normalization if configured
+/// \param thePdf The pdf with numerical normalization
+/// \param x The observable
+/// \param paramNames Config names of the shape params
+/// \param shapeParams The shape params
+/// \return \p thePdf, or rarNormCachePdf wrapping it
+///
+/// It reads the configs from the param config section:
+/// \verbatim
+/// normCache = <no|yes>
+/// normCacheBins = <nBins>
+/// normCacheStep_<param> = <step>
+/// normCacheTol = <relTol>
+/// normCacheFile = <file>\endverbatim
+/// With \p normCache set to \p yes, the normalization of \p thePdf
+/// is interpolated from a grid over its floating shape params
+/// (see rarNormCachePdf).
+/// The grid spacing of a param is \p normCacheStep_\<param\>,
+/// or its range divided by \p normCacheBins (default 200);
+/// \p normCacheTol (default 1e-4) is the relative tolerance
+/// checked in each grid cell;
+/// the grid is saved in \p normCacheFile
+/// (default \p normCache/\<name\>.root under the result dir).
+/// The wrapper takes the name of \p thePdf,
+/// which is renamed with suffix \p _raw.
+RooAbsPdf *rarBasePdf::cacheNorm(RooAbsPdf *thePdf, RooAbsReal *x,
+                                 TString paramNames, RooArgList shapeParams)
+{
+  if ("yes"!=readConfStr("normCache", "no", getVarSec())) return thePdf;
+  RooAbsRealLValue *xLV=dynamic_cast<RooAbsRealLValue*>(x);
+  if (!xLV) {
+    cout<<" W A R N I N G ! ! !"<<endl
+        <<" Observable "<<x->GetName()<<" of "<<GetName()
+        <<" is not a RooAbsRealLValue, no normalization cache"<<endl;
+    return thePdf;
+  }
+  Int_t nBins=atoi(readConfStr("normCacheBins", "200", getVarSec()));
+  Double_t tol=atof(readConfStr("normCacheTol", "1e-4", getVarSec()));
+  TString cacheFile=readConfStr("normCacheFile", getDefResultDir()+
+                                "/normCache/"+GetName()+".root", getVarSec());
+  rarStrParser paramNamesParser=paramNames;
+  TArrayD steps(shapeParams.getSize());
+  for (Int_t i=0; i<shapeParams.getSize(); i++) {
+    RooRealVar *theParam=dynamic_cast<RooRealVar*>(shapeParams.at(i));
+    Double_t defStep(0);
+    if (theParam&&(nBins>0)&&theParam->hasMin()&&theParam->hasMax())
+      defStep=(theParam->getMax()-theParam->getMin())/nBins;
+    steps[i]=defStep;
+    if (i<paramNamesParser.nArgs())
+      steps[i]=atof(readConfStr("normCacheStep_"+paramNamesParser[i],
+                                Form("%g", defStep), getVarSec()));
+  }
+  cout<<" Normalization cache for "<<GetName()<<" in "<<cacheFile<<endl;
+  TString pdfName=thePdf->GetName();
+  thePdf->SetName(pdfName+"_raw");
+  return new rarNormCachePdf(pdfName, thePdf->GetTitle(), *thePdf, *xLV,
+                             shapeParams, steps, tol, cacheFile);
+}
+
 /// \brief Pdf fit for extra Pdfs
 /// \param pdfList Pdfs need to do pdfFit
 ///
@@ -859,7 +974,7 @@ void rarBasePdf::doXPdfFit(TString pdfList)
 /// for itself. If \p pdfList is not null it will run pdfFit only
 /// when its name is in \p pdfList.
 /// It fixes any params in #_prePdfFixParamSet and calls
-/// \p fitTo of RooFit to do the fit.
+/// rarFitDriver::fit to do the fit.
 /// If there is SimPdf for this pdf, it also fits #_thisSimPdf.
 /// After fitting, it will store the fit params in a string,
 /// #_afterFitSaverStr, for later use, like plotting, etc.
@@ -889,15 +1004,12 @@ void rarBasePdf::doPdfFit(TString pdfList)
   // fitoption
   TString fitOption="hrq";
   //if (_thePdf->isExtended()) fitOption="emhr";
-  // convert to newer fitTo format for steering options
-  Bool_t pdfExtended = fitOption.Contains("e");
-  Bool_t pdfMinos    = fitOption.Contains("m");
-  Bool_t pdfHesse    = fitOption.Contains("h");
-  Bool_t pdfVerbose  = !fitOption.Contains("q");
-  Bool_t pdfSave     = fitOption.Contains("r"); // return results
  
   // get number of cpus option
   Int_t pdfFitNumCPU=atoi(readConfStr("useNumCPU", "1", getMasterSec()));
+  // fit driver (minimizer, retries, budgets)
+  rarFitDriver fitDriver;
+  setupFitDriver(fitDriver);
 
   // save obs
   string obsSaveStr;
@@ -955,10 +1067,7 @@ void rarBasePdf::doPdfFit(TString pdfList)
     cout<<endl<<" In rarBasePdf doPdfFit for "<<GetName()<< " Options: " << fitOption 
       << " using " << pdfFitNumCPU << " CPUs (if available)." << endl;
     RooFitResult *fitResult=
-      _thePdf->fitTo(*_theData,ConditionalObservables(_condObss),
-		     Save(pdfSave), Extended(pdfExtended), 
-		     Verbose(pdfVerbose), Hesse(pdfHesse),
-		     Minos(pdfMinos), NumCPU(pdfFitNumCPU));
+      fitDriver.fit(_thePdf, _theData, fitOption, _condObss, pdfFitNumCPU);
 
     saveCorrCoeffs(fitResult);
   }
@@ -1002,10 +1111,9 @@ void rarBasePdf::doPdfFit(TString pdfList)
     }
     //RooFitResult *fitResult=
     //  _thisSimPdfWOP->fitTo(*_theData,_condObss,fitOption);
-    RooFitResult *fitResult= _thisSimPdfWOP->fitTo(*_theData,ConditionalObservables(_condObss),
-						   Save(pdfSave), Extended(pdfExtended), 
-						   Verbose(pdfVerbose), Hesse(pdfHesse),
-						   Minos(pdfMinos), NumCPU(pdfFitNumCPU));
+    RooFitResult *fitResult=
+      fitDriver.fit(_thisSimPdfWOP, _theData, fitOption, _condObss,
+                    pdfFitNumCPU);
     saveCorrCoeffs(fitResult);
     //// restore params
     //readFromStr(_params, coeffSSaver);
@@ -0,0 +1,86 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides NLL wrapper with wall-time budget for RooRarFit
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides NLL wrapper with wall-time budget for RooRarFit
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+
+#include "rarBudgetNLL.hh"
+
+ClassImp(rarBudgetNLL)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param nll The NLL to wrap
+/// \param maxTime Wall-time budget in seconds (<=0 means no limit)
+///
+/// The clock starts when the wrapper is created.
+rarBudgetNLL::rarBudgetNLL(const char *name, const char *title,
+                           RooAbsReal &nll, Double_t maxTime)
+  : RooAbsReal(name, title),
+    _nll("nll", "nll", this, nll),
+    _maxTime(maxTime), _expired(kFALSE), _lastVal(0)
+{
+  _timer.Start();
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+///
+/// The copy shares the budget left of \p other.
+rarBudgetNLL::rarBudgetNLL(const rarBudgetNLL &other, const char *name)
+  : RooAbsReal(other, name),
+    _nll("nll", this, other._nll),
+    _maxTime(other._maxTime), _timer(other._timer),
+    _expired(other._expired), _lastVal(other._lastVal)
+{
+}
+
+/// \brief Trivial dtor
+rarBudgetNLL::~rarBudgetNLL()
+{
+}
+
+/// \brief Return the NLL value
+/// \return The wrapped NLL value, frozen once the budget is used up
+///
+/// Once the budget is used up, it logs one eval error,
+/// stops evaluating the wrapped NLL,
+/// and returns the frozen value silently after that,
+/// so that the minimizer sees a flat function and stops.
+Double_t rarBudgetNLL::evaluate() const
+{
+  if (!_expired) {
+    _lastVal=_nll;
+    if ((_maxTime>0)&&(_timer.RealTime()>_maxTime)) {
+      _expired=kTRUE;
+      cout<<" W A R N I N G ! ! !"<<endl
+          <<" Fit wall-time budget of "<<_maxTime<<" s exceeded for "
+          <<_nll.arg().GetName()<<endl;
+      logEvalError("fit wall-time budget exceeded");
+    }
+    _timer.Continue();
+  }
+  return _lastVal;
+}
@@ -0,0 +1,231 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides cumulative table for inverse-CDF generation
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides cumulative table for inverse-CDF generation
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include "TMath.h"
+
+#include "RooRandom.h"
+
+#include "rarCdfTable.hh"
+
+ClassImp(rarCdfTable)
+  ;
+
+/// \brief Default ctor
+///
+/// The table is empty (invalid) until #setBins or #setGrid is called.
+rarCdfTable::rarCdfTable()
+  : TObject(), _linear(kFALSE), _total(0), _maxRatio(1)
+{
+}
+
+rarCdfTable::~rarCdfTable()
+{
+}
+
+/// \brief Build table for density constant within bins
+/// \param limits Bin limits (nBins+1)
+/// \param contents Integral in each bin (nBins)
+///
+/// Negative contents are treated as zero.
+void rarCdfTable::setBins(const TArrayD &limits, const TArrayD &contents)
+{
+  Int_t nBins=limits.GetSize()-1;
+  _linear=kFALSE;
+  _x=limits;
+  _f.Set(nBins>0?nBins:0);
+  _cdf.Set(nBins+1);
+  _total=0;
+  _maxRatio=1;
+  if (nBins<1) return;
+  _cdf[0]=0;
+  for (Int_t i=0; i<nBins; i++) {
+    Double_t content=(i<contents.GetSize())?contents[i]:0;
+    if (content<0) content=0;
+    Double_t width=_x[i+1]-_x[i];
+    _f[i]=(width>0)?content/width:0;
+    _cdf[i+1]=_cdf[i]+content;
+  }
+  _total=_cdf[nBins];
+}
+
+/// \brief Build table for density linear between equidistant points
+/// \param xlo Low edge
+/// \param xhi High edge
+/// \param values Density at nPoints points from \p xlo to \p xhi
+/// \param midValues Density at the midpoints of the cells (optional)
+///
+/// Negative values are treated as zero.
+/// With \p midValues, the bound of the ratio of the density
+/// to its linear interpolation is kept for #accept.
+void rarCdfTable::setGrid(Double_t xlo, Double_t xhi, const TArrayD &values,
+                          const TArrayD *midValues)
+{
+  Int_t nCells=values.GetSize()-1;
+  _linear=kTRUE;
+  _x.Set(nCells>0?nCells+1:0);
+  _f.Set(nCells>0?nCells+1:0);
+  _cdf.Set(nCells>0?nCells+1:0);
+  _total=0;
+  _maxRatio=1;
+  if ((nCells<1)||(xhi<=xlo)) return;
+  Double_t step=(xhi-xlo)/nCells;
+  for (Int_t i=0; i<=nCells; i++) {
+    _x[i]=xlo+i*step;
+    _f[i]=(values[i]>0)?values[i]:0;
+  }
+  _x[nCells]=xhi;
+  _cdf[0]=0;
+  for (Int_t i=0; i<nCells; i++)
+    _cdf[i+1]=_cdf[i]+.5*(_f[i]+_f[i+1])*(_x[i+1]-_x[i]);
+  _total=_cdf[nCells];
+  if (!midValues) return;
+  // ratio of the density to the interpolation peaks near cell midpoints
+  for (Int_t i=0; (i<nCells)&&(i<midValues->GetSize()); i++) {
+    Double_t interp=.5*(_f[i]+_f[i+1]);
+    if ((interp>0)&&((*midValues)[i]>_maxRatio*interp))
+      _maxRatio=(*midValues)[i]/interp;
+  }
+  // margin for the ratio off the midpoints
+  _maxRatio*=1.01;
+}
+
+/// \brief Check if the table is built for the param state
+/// \param state Current param state
+/// \return True if the table is valid and built for \p state
+///
+/// If not, the state is recorded, and the caller should rebuild the table.
+Bool_t rarCdfTable::isUpToDate(const TArrayD &state)
+{
+  Bool_t upToDate=isValid()&&(_state.GetSize()==state.GetSize());
+  for (Int_t i=0; upToDate&&(i<state.GetSize()); i++)
+    if (_state[i]!=state[i]) upToDate=kFALSE;
+  if (!upToDate) _state=state;
+  return upToDate;
+}
+
+/// \brief Find the cell containing x
+/// \param x The value
+/// \return Cell index, clamped to the table
+Int_t rarCdfTable::findCell(Double_t x) const
+{
+  Int_t nCells=_x.GetSize()-1;
+  Int_t i=TMath::BinarySearch(_x.GetSize(), _x.GetArray(), x);
+  if (i<0) i=0;
+  if (i>nCells-1) i=nCells-1;
+  return i;
+}
+
+/// \brief Return cumulative integral up to x
+/// \param x The value
+/// \return Integral of the density from the low edge to \p x
+Double_t rarCdfTable::cdf(Double_t x) const
+{
+  if (!isValid()) return 0;
+  if (x<=_x[0]) return 0;
+  if (x>=_x[_x.GetSize()-1]) return _total;
+  Int_t i=findCell(x);
+  Double_t t=x-_x[i];
+  if (!_linear) return _cdf[i]+_f[i]*t;
+  Double_t slope=(_f[i+1]-_f[i])/(_x[i+1]-_x[i]);
+  return _cdf[i]+_f[i]*t+.5*slope*t*t;
+}
+
+/// \brief Invert the cumulative integral
+/// \param c Cumulative integral (0 to total)
+/// \return The value where the cumulative integral reaches \p c
+Double_t rarCdfTable::inverse(Double_t c) const
+{
+  if (!isValid()) return 0;
+  Int_t nCells=_x.GetSize()-1;
+  if (c<=0) return _x[0];
+  if (c>=_total) return _x[nCells];
+  Int_t i=TMath::BinarySearch(_cdf.GetSize(), _cdf.GetArray(), c);
+  if (i<0) i=0;
+  if (i>nCells-1) i=nCells-1;
+  // skip empty cells
+  while ((i<nCells-1)&&(_cdf[i+1]<=c)) i++;
+  Double_t r=c-_cdf[i];
+  Double_t width=_x[i+1]-_x[i];
+  Double_t t(0);
+  if (!_linear) {
+    if (_f[i]>0) t=r/_f[i];
+  } else {
+    // solve .5*slope*t^2 + f*t = r
+    Double_t slope=(_f[i+1]-_f[i])/width;
+    Double_t disc=_f[i]*_f[i]+2.*slope*r;
+    if (disc<0) disc=0;
+    Double_t den=_f[i]+sqrt(disc);
+    if (den>0) t=2.*r/den;
+  }
+  if (t<0) t=0;
+  if (t>width) t=width;
+  return _x[i]+t;
+}
+
+/// \brief Return density of the table at x
+/// \param x The value
+/// \return Density (constant in bin or interpolated) at \p x
+Double_t rarCdfTable::density(Double_t x) const
+{
+  if (!isValid()) return 0;
+  if ((x<_x[0])||(x>_x[_x.GetSize()-1])) return 0;
+  Int_t i=findCell(x);
+  if (!_linear) return _f[i];
+  return _f[i]+(_f[i+1]-_f[i])*(x-_x[i])/(_x[i+1]-_x[i]);
+}
+
+/// \brief Generate a value within a range
+/// \param xlo Low edge of the range
+/// \param xhi High edge of the range
+/// \return The generated value
+Double_t rarCdfTable::generate(Double_t xlo, Double_t xhi) const
+{
+  Double_t clo=cdf(xlo);
+  Double_t chi=cdf(xhi);
+  Double_t x=inverse(clo+RooRandom::uniform()*(chi-clo));
+  if (x<xlo) x=xlo;
+  if (x>xhi) x=xhi;
+  return x;
+}
+
+/// \brief Accept or reject a value generated from the table
+/// \param x The value from #generate
+/// \param f The exact density (same scale as the table) at \p x
+/// \return True if accepted
+///
+/// A caller generating until a value is accepted gets values
+/// following \p f rather than the table.
+/// If \p f exceeds the bound, the value is accepted,
+/// the bound raised, and a warning printed.
+Bool_t rarCdfTable::accept(Double_t x, Double_t f)
+{
+  Double_t g=density(x);
+  if (g<=0) return kTRUE;
+  if (f>_maxRatio*g) {
+    cout<<" W A R N I N G !"<<endl
+        <<" rarCdfTable::accept: density "<<f<<" at "<<x
+        <<" exceeds the bound "<<_maxRatio*g<<", bound raised"<<endl;
+    _maxRatio=1.01*f/g;
+    return kTRUE;
+  }
+  return RooRandom::uniform()*_maxRatio*g<=f;
+}
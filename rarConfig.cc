@@ -21,9 +21,12 @@
 
 #include "Riostream.h"
 #include <sstream>
+#include <map>
+#include <set>
 #include <vector>
 
 #include <ctype.h>
+#include <pthread.h>
 
 #include "TFile.h"
 #include "TTree.h"
@@ -40,6 +43,7 @@
 #include "RooMappedCategory.h"
 #include "RooRandom.h"
 #include "RooRealVar.h"
+#include "RooStreamParser.h"
 #include "RooStringVar.h"
 #include "RooThresholdCategory.h"
 #include "RooGlobalFunc.h"
@@ -50,6 +54,7 @@
 
 #include "rarAdd.hh"
 #include "rarArgusBG.hh"
+#include "rarAsciiReader.hh"
 #include "rarDecay.hh"
 #include "rarBasePdf.hh"
 #include "rarBifurGauss.hh"
@@ -95,6 +100,11 @@ RooArgSet rarConfig::_rarCats;
 TString rarConfig::_masterSec;
 TString rarConfig::_runSec;
 
+/// \brief Indexed config stores of all config files read by #readConfStr
+static map<string, rarConfStore> rarConfStores;
+/// \brief Config files which can not be indexed (with if/echo/abort)
+static set<string> rarConfNoStores;
+
 /// \brief Trivial ctor
 ///
 /// Usually the objects should be created using other ctors.
@@ -240,9 +250,11 @@ TString rarConfig::getFileName(const TString in_name) const
 /// \return The string it reads in
 ///
 /// A utility function to read in a config item as a string.
-/// It actually uses RooFit's
+/// The config file is parsed only once into an indexed store
+/// (see #indexConfFile) following the rules of RooFit's
 /// <a href="http://roofit.sourceforge.net/docs/classref/RooArgSet.html#RooArgSet:readFromFile" target=_blank>RooArgSet::readFromFile</a>
-/// function.
+/// function, which is still used for config files
+/// with conditional (if/else/endif) directives.
 TString rarConfig::readConfStr(const char *name, const char *val,
 			       const char *secName)
 {
@@ -254,17 +266,116 @@ TString rarConfig::readConfStr(const char *name, const char *val,
   RooStringVar *theStr=(RooStringVar*)(_configStrSet.find(secVarName));
   if (theStr) return theStr->getVal();
   // not read in yet, try to get it from config file
-  RooArgSet strList("Read Config String List");
-  RooStringVar strVar(name, "config string", val, 40960);
-  strList.add(strVar);
-  strList.readFromFile(_configFile, 0, configSec);
+  TString theVal=val;
+  const rarConfStore *theStore=indexConfFile(_configFile);
+  if (theStore) {
+    rarConfStore::const_iterator theSec=
+      theStore->find(string(Form("[%s]", configSec.Data())));
+    if (theSec!=theStore->end()) {
+      map<string, string>::const_iterator theConf=theSec->second.find(name);
+      if (theConf!=theSec->second.end()) theVal=theConf->second.c_str();
+    }
+  } else {
+    RooArgSet strList("Read Config String List");
+    RooStringVar strVar(name, "config string", val, 40960);
+    strList.add(strVar);
+    strList.readFromFile(_configFile, 0, configSec);
+    theVal=strVar.getVal();
+  }
   
-  Int_t strLen=strlen(strVar.getVal())+1;
+  Int_t strLen=theVal.Length()+1;
   if (strLen<1024) strLen=1024;
-  if (strVar.getVal()!=TString(val)) _configStrSet.addOwned
-    (*(new RooStringVar(secVarName, secVarName, strVar.getVal(), strLen)));
+  if (theVal!=TString(val)) _configStrSet.addOwned
+    (*(new RooStringVar(secVarName, secVarName, theVal, strLen)));
   
-  return strVar;
+  return theVal;
+}
+
+/// \brief Parse a config file into the indexed config store
+/// \param configFile The config file
+/// \return The config store of the file, or 0 if it can not be indexed
+///
+/// The config file is parsed once, as RooArgSet::readFromFile does,
+/// but all configs of all sections are kept.
+/// A config included inside a section belongs to that section
+/// (and to its own section in the included file);
+/// a later config of the same name overrides the earlier one.
+/// Files with if/else/endif, echo, or abort directives
+/// are not indexed.
+const rarConfStore *rarConfig::indexConfFile(const char *configFile)
+{
+  string fileName=configFile;
+  map<string, rarConfStore>::const_iterator theStore=
+    rarConfStores.find(fileName);
+  if (theStore!=rarConfStores.end()) return &theStore->second;
+  if (rarConfNoStores.count(fileName)) return 0;
+  rarConfStore theConfs;
+  if (parseConfFile(configFile, set<string>(), theConfs)) {
+    rarConfNoStores.insert(fileName);
+    return 0;
+  }
+  rarConfStores[fileName]=theConfs;
+  return &rarConfStores[fileName];
+}
+
+/// \brief Parse a config file (or included file) into config store
+/// \param configFile The config file
+/// \param inSecs Sections in which the file is included
+/// \param theConfs The config store to fill
+/// \return True if the file can not be indexed
+Bool_t rarConfig::parseConfFile(const char *configFile,
+                                const set<string> &inSecs,
+                                rarConfStore &theConfs)
+{
+  ifstream ifs(configFile);
+  if (ifs.fail()) {
+    cout<<" Can not open config file "<<configFile<<endl;
+    return kTRUE;
+  }
+  RooStreamParser parser(ifs);
+  parser.setPunctuation("=");
+  string secHdr("");
+  Bool_t hasSec(kFALSE);
+  while (!(ifs.eof()||ifs.fail()||parser.atEOF())) {
+    TString token=parser.readToken();
+    if (token.IsNull()) continue;
+    // sections the config goes to
+    set<string> theSecs(inSecs);
+    if (hasSec) theSecs.insert(secHdr);
+    // include file
+    if ("include"==token) {
+      if (parser.atEOL()) return kTRUE;
+      TString incFile=parser.readLine();
+      if (parseConfFile(incFile, theSecs, theConfs)) return kTRUE;
+      continue;
+    }
+    // section header
+    if ('['==token[0]) {
+      TString hdr(token);
+      if (!token.EndsWith("]")) hdr+=" "+parser.readLine();
+      secHdr=hdr.Data();
+      hasSec=kTRUE;
+      continue;
+    }
+    // directives needing evaluation can not be indexed
+    if (("if"==token)||("else"==token)||("endif"==token)||
+        ("echo"==token)||("abort"==token)) return kTRUE;
+    // not in any section
+    if (theSecs.size()<=0) {
+      parser.zapToEnd(kTRUE);
+      continue;
+    }
+    // config name = config string
+    if (parser.expectToken("=", kTRUE)) continue;
+    TString theVal=parser.readLine();
+    // too long for RooStringVar of readConfStr
+    if (theVal.Length()>=40960) continue;
+    for (set<string>::const_iterator it=theSecs.begin();
+         it!=theSecs.end(); ++it)
+      theConfs[*it][token.Data()]=theVal.Data();
+  }
+  
+  return kFALSE;
 }
 
 /// \brief Set a config string
@@ -1279,6 +1390,8 @@ void rarConfig::addColumns(RooDataSet *data, Bool_t addColmns,
 ///
 /// \param dsStr The dataset config string
 /// \param isUB Returned boolean for the ub status
+/// \param fingerprint Returned fingerprint of the dataset (see rarFingerprint),
+///        empty if it is not known without a pass over the events
 /// \return The dataset created
 ///
 /// It creates a \p RooDataSet object according to its config string,
@@ -1289,10 +1402,15 @@ void rarConfig::addColumns(RooDataSet *data, Bool_t addColmns,
 /// and it is the name of config item in the config section.
 /// The next token, \p dsType, is the dataset type, i.e.,
 /// how the dataset will be created.
+/// With config \p asciiThreads = \p n (>0), \p ascii datasets
+/// without \p indexCatName are read in by rarAsciiReader
+/// with \p n threads, which also computes their fingerprints.
 /// <a href="http://rarfit.sourceforge.net/RooRarFit.html#sec_dsi">See doc for Dataset Input Section</a> for more details.
-RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wgtVarName)
+RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wgtVarName,
+                                     TString *fingerprint)
 {
   isUB=kFALSE;
+  if (fingerprint) *fingerprint="";
   rarStrParser datasetStrParser=dsStr;
   TString myName=datasetStrParser[0];
   datasetStrParser.Remove();
@@ -1305,7 +1423,24 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
   RooDataSet *data(0);
   if ("ascii"==dsType) { // dealing with ascii text file method
     RooDataSet *theData(0); // temporary data set
-    if (1==datasetStrParser.nArgs()) { // #1
+    Bool_t withAddOns(kFALSE); // addOns added by reader?
+    TString readerFingerprint(""); // fingerprint from reader
+    // multi-threaded reader (w/o indexCatName)?
+    Int_t asciiThreads=atoi(readConfStr("asciiThreads", "0"));
+    if ((asciiThreads>0)&&(datasetStrParser.nArgs()>=1)&&
+        (datasetStrParser.nArgs()<=3)) {
+      rarAsciiReader asciiReader(*getPrimaryObs(), asciiThreads);
+      asciiReader.setWeightVar(wgtVarName);
+      if (getAddOnCols()) withAddOns=asciiReader.setAddOns(*getAddOnCols());
+      theData=asciiReader.read(datasetStrParser[0], datasetStrParser.nArgs()>2?
+                               datasetStrParser[2].Data():0);
+      if (!theData) withAddOns=kFALSE;
+      // the fingerprint holds only if no column is added afterwards
+      else if (withAddOns||!getAddOnCols())
+        readerFingerprint=asciiReader.getFingerprint();
+    }
+    if (theData) ;
+    else if (1==datasetStrParser.nArgs()) { // #1
       theData=RooDataSet::read(datasetStrParser[0], *getPrimaryObs());
     } else if(2==datasetStrParser.nArgs()) { // #2, with options
       theData=RooDataSet::read(datasetStrParser[0], *getPrimaryObs(),
@@ -1330,9 +1465,13 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
     // f.ls();
     // f.Close();
     // RooDataSet *d = (RooDataSet*) f.FindObject("d");
-    addColumns(theData);
+    addColumns(theData, !withAddOns);
     // copy and add weight variable
     data=new RooDataSet("asciiData", "asciiData", theData, *_fullObs, "1", wgtVarName);
+    // same events and columns (the weight column is the weight)?
+    if (fingerprint&&(data->numEntries()==theData->numEntries())&&
+        (data->get()->getSize()+(data->isWeighted()?1:0)==
+         theData->get()->getSize())) *fingerprint=readerFingerprint;
   } else if ("root"==dsType) { // dealing with root file
     if (datasetStrParser.nArgs()<2) {
       cout<<"At least two more args needed"<<endl;
@@ -1350,6 +1489,10 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
       exit(-1);
     }
     
+    // read in only branches of observables?
+    if ("yes"==readConfStr("rootBranchSelect", "no"))
+      selectBranches(tree, wgtVarName);
+    
     // now create the dataset and add weight variable at same time
     RooArgSet primaryObs = *getPrimaryObs();
     if (wgtVarName != "") {
@@ -1370,6 +1513,8 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
     }
     cout<<endl;
     data=new RooDataSet("addData", "add dataset", *_fullObs);
+    // sample with replacement (bootstrap)?
+    Bool_t withReplacement=("yes"==readConfStr("addWithReplacement", "no"));
     Int_t nDS=datasetStrParser.nArgs()/2;
     for (Int_t i=0; i<nDS; i++) {
       // get dataset #i
@@ -1383,26 +1528,32 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
       if (nEvtScale<1) { // if less than 1, it is scaling factor
 	nEvt=(Int_t)(.5+nEvtScale*srcNevt);
       }
-      if ((nEvt<=0) || (nEvt>srcNevt)) nEvt=srcNevt;
-      if ((nEvt>0)&&(nEvt<srcNevt)) isUB=kTRUE;
+      if ((nEvt<=0) || ((nEvt>srcNevt)&&!withReplacement)) nEvt=srcNevt;
+      if ((nEvt>0)&&((nEvt<srcNevt)||withReplacement)) isUB=kTRUE;
       cout<<" Adding "<<nEvt<<" events from "<<theData->GetName()<<endl;
+      if (srcNevt<=0) continue;
       // create index vector
       vector<Int_t> indexVector;
-      for (Int_t j=0; j<srcNevt; j++) {
-	indexVector.push_back(j);
+      if (!withReplacement) {
+	indexVector.resize(srcNevt);
+	for (Int_t j=0; j<srcNevt; j++) indexVector[j]=j;
       }
       for (Int_t j=0; j<nEvt; j++) {
 	// random access to index to make sure the sample added
 	// is not sequence dependent to the src data
-	Int_t randomIdx=
-	  RooRandom::randomGenerator()->Integer(indexVector.size());
-	RooArgSet *theRow=(RooArgSet *)theData->get(indexVector[randomIdx]);
+	Int_t theIdx(0);
+	if (withReplacement) {
+	  theIdx=RooRandom::randomGenerator()->Integer(srcNevt);
+	} else {
+	  // partial Fisher-Yates shuffle: the first j indices are selected,
+	  // swap a random one of the rest into place j
+	  Int_t randomIdx=j+RooRandom::randomGenerator()->Integer(srcNevt-j);
+	  theIdx=indexVector[randomIdx];
+	  indexVector[randomIdx]=indexVector[j];
+	  indexVector[j]=theIdx;
+	}
+	RooArgSet *theRow=(RooArgSet *)theData->get(theIdx);
 	data->add(*theRow);
-	// remove the index so it won't be selected again
-	vector<Int_t>::iterator the_iterator;
-	the_iterator=indexVector.begin();
-	the_iterator+=randomIdx;
-	indexVector.erase(the_iterator);
       }
     }
     addColumns(data);
@@ -1454,11 +1605,122 @@ RooDataSet *rarConfig::createDataSet(const char *dsStr, Bool_t &isUB, TString wg
   return data;
 }
 
+/// \brief Activate only the branches of observables in a tree
+/// \param tree The tree
+/// \param wgtVarName Name of weight variable
+///
+/// With config \p rootBranchSelect = \p yes,
+/// only branches of primary observables (and the weight)
+/// are active when a \p root dataset is created,
+/// so RooFit copies and reads only those branches
+/// (the cut is on observables only),
+/// and they are read through a tree cache
+/// of \p rootCacheSize MB (default 30).
+void rarConfig::selectBranches(TTree *tree, TString wgtVarName)
+{
+  RooArgList obsList(*getPrimaryObs());
+  tree->SetBranchStatus("*", 0);
+  Int_t cacheSize=atoi(readConfStr("rootCacheSize", "30"));
+  if (cacheSize>0) tree->SetCacheSize(cacheSize*1024*1024);
+  Int_t nBranches(0);
+  for (Int_t i=0; i<=obsList.getSize(); i++) {
+    TString branchName=(i<obsList.getSize())?obsList.at(i)->GetName():
+      wgtVarName.Data();
+    if (""==branchName) continue;
+    // categories can be stored by index or label too
+    TString branchNames[3]={branchName, branchName+"_idx", branchName+"_lbl"};
+    for (Int_t j=0; j<3; j++) {
+      if (!tree->GetBranch(branchNames[j])) continue;
+      tree->SetBranchStatus(branchNames[j], 1);
+      if (cacheSize>0) tree->AddBranchToCache(branchNames[j], kTRUE);
+      nBranches++;
+    }
+  }
+  cout<<" Read in "<<nBranches<<" out of "
+      <<tree->GetListOfBranches()->GetEntries()
+      <<" branches of tree "<<tree->GetName()<<endl;
+}
+
+/// \brief Weighted co-moment accumulator
+///
+/// It sums the weighted deviations of each event from a common shift
+/// (the first event), and their products,
+/// so accumulators of separate chunks merge by plain addition,
+/// and no division by a running sum of weights is needed
+/// (which can vanish with negative weights).
+/// The shift keeps the sums small, as a running mean would.
+struct rarCovAcc {
+  rarCovAcc(unsigned nPar) : _nPar(nPar), _rows(0), _nRows(0), _shift(0),
+                             _sumWD(nPar), _sumWDD(nPar*nPar), _d(nPar)
+  {reset();}
+  /// \brief Reset sums
+  void reset()
+  {
+    _sumW=0;
+    for (unsigned j=0; j<_nPar; j++) _sumWD[j]=0;
+    for (unsigned j=0; j<_nPar*_nPar; j++) _sumWDD[j]=0;
+  }
+  /// \brief Add an event
+  /// \param x Values (and the weight after them)
+  void add(const Double_t *x)
+  {
+    Double_t w=x[_nPar];
+    if (w==0) return;
+    _sumW+=w;
+    for (unsigned j=0; j<_nPar; j++) {
+      _d[j]=x[j]-_shift[j];
+      _sumWD[j]+=w*_d[j];
+    }
+    for (unsigned j=0; j<_nPar; j++) for (unsigned k=0; k<_nPar; k++)
+      _sumWDD[j*_nPar+k]+=w*_d[j]*_d[k];
+  }
+  /// \brief Merge another accumulator (with the same shift)
+  /// \param other The accumulator to merge
+  void merge(const rarCovAcc &other)
+  {
+    _sumW+=other._sumW;
+    for (unsigned j=0; j<_nPar; j++) _sumWD[j]+=other._sumWD[j];
+    for (unsigned j=0; j<_nPar*_nPar; j++) _sumWDD[j]+=other._sumWDD[j];
+  }
+  /// \brief Return a weighted co-moment
+  /// \param j Index of first variable
+  /// \param k Index of second variable
+  /// \return The co-moment about the weighted means
+  ///
+  /// The sum of weights must not be zero.
+  Double_t comoment(unsigned j, unsigned k) const
+  {
+    return _sumWDD[j*_nPar+k]-_sumWD[j]*_sumWD[k]/_sumW;
+  }
+  /// \brief Accumulate the rows assigned (thread function)
+  /// \param arg The accumulator
+  /// \return Null
+  static void *run(void *arg)
+  {
+    rarCovAcc &acc=*(rarCovAcc*)arg;
+    for (unsigned i=0; i<acc._nRows; i++)
+      acc.add(acc._rows+i*(acc._nPar+1));
+    return 0;
+  }
+  unsigned _nPar; ///< Number of variables
+  const Double_t *_rows; ///< Rows to accumulate
+  unsigned _nRows; ///< Number of rows to accumulate
+  const Double_t *_shift; ///< Shift of the values
+  Double_t _sumW; ///< Sum of weights
+  vector<Double_t> _sumWD; ///< Weighted sums of deviations
+  vector<Double_t> _sumWDD; ///< Weighted sums of deviation products
+  vector<Double_t> _d; ///< Work space
+};
+
 /// \brief To compute correlation matrix for dataset
 /// \param varList The vars to compute
 /// \param data The dataset to compute
 ///
-/// It computes the correlation matrix for given dataset.
+/// It computes the correlation matrix for given dataset,
+/// weighted with the event weights,
+/// in a single pass over the events.
+/// With config \p corrThreads = \p n in the master section,
+/// blocks of events are accumulated by \p n threads.
 void rarConfig::computeCorrelations(RooArgList varList,
 				    const RooDataSet *data) {
   RooArgSet theFVars(*data->get());
@@ -1477,32 +1739,63 @@ void rarConfig::computeCorrelations(RooArgList varList,
   unsigned i,j,k;
   unsigned nEvt = data->numEntries();
   unsigned nPar =  theVars.getSize();
-  double* average = new double[nPar];
   RooAbsReal **arg = new RooAbsReal*[nPar];
   TIterator* iter = theVars.createIterator();
   i=0;
   RooAbsArg *y(0);
   while ( (y=(RooAbsArg*)(iter->Next())) ) {
     arg[i] =  dynamic_cast<RooAbsReal*>(y);
-    average[i]=0;
     i++;
   }
-  for (i=0;i<nEvt;++i) {
-    data->get(i);
-    for (unsigned j=0;j<nPar;++j)
-      if (arg[j]!=0) average[j]+=(arg[j]->getVal())/nEvt;
+  delete iter;
+  // single pass, with events read in blocks and accumulated
+  // by nThreads threads (see rarCovAcc)
+  Int_t nThreads=atoi(readConfStr("corrThreads", "1", getMasterSec()));
+  if (nThreads<1) nThreads=1;
+  const unsigned blockSize=65536;
+  vector<Double_t> block(blockSize*(nPar+1));
+  vector<Double_t> shift(nPar, 0);
+  rarCovAcc total(nPar);
+  vector<rarCovAcc> accs(nThreads, rarCovAcc(nPar));
+  for (Int_t t=0; t<nThreads; t++) accs[t]._shift=&shift[0];
+  vector<pthread_t> threads(nThreads);
+  for (unsigned iBeg=0; iBeg<nEvt; iBeg+=blockSize) {
+    unsigned nRows=(nEvt-iBeg<blockSize)?nEvt-iBeg:blockSize;
+    // fill the block (RooFit access is not thread safe)
+    for (i=0; i<nRows; i++) {
+      data->get(iBeg+i);
+      Double_t *row=&block[i*(nPar+1)];
+      for (j=0; j<nPar; j++) row[j]=(arg[j]!=0)?arg[j]->getVal():0;
+      row[nPar]=data->weight();
+    }
+    if (0==iBeg) for (j=0; j<nPar; j++) shift[j]=block[j];
+    // accumulate chunks in parallel, merge in chunk order
+    for (Int_t t=0; t<nThreads; t++) {
+      accs[t].reset();
+      accs[t]._rows=&block[(nRows*t/nThreads)*(nPar+1)];
+      accs[t]._nRows=nRows*(t+1)/nThreads-nRows*t/nThreads;
+    }
+    vector<Bool_t> started(nThreads, kFALSE);
+    for (Int_t t=1; t<nThreads; t++)
+      started[t]=!pthread_create(&threads[t], 0, rarCovAcc::run, &accs[t]);
+    rarCovAcc::run(&accs[0]);
+    for (Int_t t=1; t<nThreads; t++) {
+      if (started[t]) pthread_join(threads[t], 0);
+      else rarCovAcc::run(&accs[t]);
+    }
+    for (Int_t t=0; t<nThreads; t++) total.merge(accs[t]);
+  }
+  if (total._sumW==0) {
+    cout<<" W A R N I N G !"<<endl
+        <<" Sum of weights of "<<data->GetName()
+        <<" is zero; no correlation matrix"<<endl;
+    delete[] arg;
+    return;
   }
   double** cor = new double*[nPar];
   for (i=0;i<nPar;++i) {
     cor[i] = new double[nPar];
-    for (unsigned j=0;j<nPar;++j) cor[i][j]=0;
-  }
-  for (i=0;i<nEvt;++i) {
-    data->get(i);
-    for (j=0;j<nPar;++j) for (k=0;k<nPar;++k) {
-      if (arg[j]!=0)
-	cor[j][k]+=(arg[j]->getVal()-average[j])*(arg[k]->getVal()-average[k]);
-    }
+    for (j=0;j<nPar;++j) cor[i][j]=total.comoment(i, j);
   }
   for (j=0;j<nPar;++j) for (k=0;k<nPar;++k)  {
     if (j!=k && arg[j]!=0 && arg[k]!=0)
@@ -1534,7 +1827,6 @@ void rarConfig::computeCorrelations(RooArgList varList,
   }
   cout << endl;
   delete[] cor;
-  delete[] average;
   delete[] arg;
 
   // FFW but only outside babar
@@ -0,0 +1,217 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides per-event cache of convolved basis functions
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides per-event cache of convolved basis functions
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+
+#include "RooAbsAnaConvPdf.h"
+#include "RooAbsCategory.h"
+#include "RooAbsReal.h"
+#include "RooArgList.h"
+#include "RooArgSet.h"
+#include "RooListProxy.h"
+
+#include "rarConvCache.hh"
+
+ClassImp(rarConvCache)
+  ;
+
+/// Default maximum number of events cached
+static const Int_t rarConvCacheMaxSlots=1000000;
+
+/// \brief Default ctor
+///
+/// The cache is empty until the first evaluation.
+rarConvCache::rarConvCache()
+  : TObject(), _leaves(0), _nKey(0), _nVals(0), _nSlots(0),
+    _maxSlots(rarConvCacheMaxSlots), _cursor(0), _overflow(kFALSE)
+{
+}
+
+/// \brief Copy ctor
+///
+/// The cache is not copied, only its maximum number of slots;
+/// the leaves of the copy are those of its own basis functions.
+rarConvCache::rarConvCache(const rarConvCache &other)
+  : TObject(other), _leaves(0), _nKey(0), _nVals(0), _nSlots(0),
+    _maxSlots(other._maxSlots), _cursor(0), _overflow(kFALSE)
+{
+}
+
+rarConvCache::~rarConvCache()
+{
+  delete _leaves;
+}
+
+/// \brief Drop all cached events and the leaf list
+///
+/// It should be called whenever the servers of the pdf are redirected.
+void rarConvCache::reset()
+{
+  delete _leaves;
+  _leaves=0;
+  _nKey=_nVals=_nSlots=_cursor=0;
+  _overflow=kFALSE;
+  _keys.Set(0);
+  _vals.Set(0);
+}
+
+/// \brief Set maximum number of events cached
+/// \param maxSlots Maximum number of slots (<=0 to disable the cache)
+///
+/// It should be at least the number of events fitted;
+/// the memory used is about 8 bytes times the number of leaves
+/// and basis functions per slot.
+/// The cache is reset.
+void rarConvCache::setMaxSlots(Int_t maxSlots)
+{
+  reset();
+  _maxSlots=(maxSlots>0)?maxSlots:0;
+}
+
+/// \brief Find the slot of current event
+/// \param convSet The convolved basis functions
+/// \param extraKey Extra key value (eg, integration code)
+/// \param hit Set to true if the slot holds valid values
+/// \return Cached values of the slot
+///
+/// The slot expected next is tried first, then the first one.
+/// On a miss, the next slot is claimed for current event,
+/// and the caller should fill its values.
+/// Once the cache is full, events past the last slot are not cached;
+/// their values are filled in a scratch slot every time.
+Double_t *rarConvCache::find(const RooListProxy &convSet, Double_t extraKey,
+                             Bool_t &hit)
+{
+  if (!_leaves) {
+    _leaves=new RooArgList("convCacheLeaves");
+    RooArgSet leafSet;
+    for (Int_t i=0; i<convSet.getSize(); i++) {
+      RooArgSet *vars=convSet.at(i)->getVariables();
+      leafSet.add(*vars, kTRUE);
+      delete vars;
+    }
+    _leaves->add(leafSet);
+    _nKey=_leaves->getSize()+1;
+    _nVals=convSet.getSize();
+    _nSlots=_cursor=0;
+    _curKey.Set(_nKey);
+    _extraVals.Set(_nVals);
+  }
+  // current key
+  for (Int_t i=0; i<_nKey-1; i++) {
+    RooAbsArg *leaf=_leaves->at(i);
+    RooAbsReal *rLeaf=dynamic_cast<RooAbsReal*>(leaf);
+    if (rLeaf) _curKey[i]=rLeaf->getVal();
+    else _curKey[i]=((RooAbsCategory*)leaf)->getIndex();
+  }
+  _curKey[_nKey-1]=extraKey;
+  // try the expected slot, then the first one
+  Int_t tries[2]={_cursor, 0};
+  for (Int_t t=0; t<2; t++) {
+    Int_t slot=tries[t];
+    if (slot>=_nSlots) continue;
+    const Double_t *key=_keys.GetArray()+slot*_nKey;
+    Bool_t match(kTRUE);
+    for (Int_t i=0; match&&(i<_nKey); i++)
+      if (key[i]!=_curKey[i]) match=kFALSE;
+    if (match) {
+      _cursor=slot+1;
+      hit=kTRUE;
+      return _vals.GetArray()+slot*_nVals;
+    }
+  }
+  // claim a slot
+  Int_t slot=_cursor;
+  if (slot>=_nSlots) {
+    if (_nSlots>=_maxSlots) { // full, do not evict
+      if (!_overflow)
+        cout<<" W A R N I N G !"<<endl
+            <<" rarConvCache: more than "<<_maxSlots<<" events,"
+            <<" the rest are not cached"<<endl;
+      _overflow=kTRUE;
+      hit=kFALSE;
+      return _extraVals.GetArray();
+    }
+    slot=_nSlots++;
+    if (_nSlots*_nKey>_keys.GetSize()) {
+      Int_t size=2*_nSlots;
+      if (size>_maxSlots) size=_maxSlots;
+      _keys.Set(size*_nKey);
+      _vals.Set(size*_nVals);
+    }
+  }
+  Double_t *key=_keys.GetArray()+slot*_nKey;
+  for (Int_t i=0; i<_nKey; i++) key[i]=_curKey[i];
+  _cursor=slot+1;
+  hit=kFALSE;
+  return _vals.GetArray()+slot*_nVals;
+}
+
+/// \brief Evaluate the pdf from cached basis functions
+/// \param pdf The pdf
+/// \param convSet Its convolved basis functions
+/// \return Sum of coefficients times convolved basis functions
+///
+/// Same as RooAbsAnaConvPdf::evaluate,
+/// but the basis functions are only evaluated for events not cached.
+Double_t rarConvCache::evaluate(const RooAbsAnaConvPdf &pdf,
+                                const RooListProxy &convSet)
+{
+  Bool_t hit(kFALSE);
+  Double_t *vals=find(convSet, 0, hit);
+  if (!hit)
+    for (Int_t i=0; i<_nVals; i++)
+      vals[i]=((RooAbsReal*)convSet.at(i))->getVal(0);
+  Double_t result(0);
+  for (Int_t i=0; i<_nVals; i++) {
+    Double_t coef=pdf.coefficient(i);
+    if (coef!=0) result+=coef*vals[i];
+  }
+  return result;
+}
+
+/// \brief Integrate the pdf from cached basis integrals
+/// \param pdf The pdf
+/// \param convSet Its convolved basis functions
+/// \param intCoefSet Variables to integrate the coefficients over
+/// \param intConvSet Variables to integrate the basis functions over
+/// \param code Integration code (part of the key)
+/// \return Sum of coefficient integrals times basis integrals
+///
+/// Same as the unnormalized integral of RooAbsAnaConvPdf,
+/// but the basis integrals are only computed for events not cached.
+Double_t rarConvCache::integral(const RooAbsAnaConvPdf &pdf,
+                                const RooListProxy &convSet,
+                                const RooArgSet *intCoefSet,
+                                const RooArgSet *intConvSet, Int_t code)
+{
+  Bool_t hit(kFALSE);
+  Double_t *vals=find(convSet, code, hit);
+  if (!hit)
+    for (Int_t i=0; i<_nVals; i++)
+      vals[i]=((RooAbsPdf*)convSet.at(i))->getNorm(intConvSet);
+  Double_t result(0);
+  for (Int_t i=0; i<_nVals; i++) {
+    Double_t coef=pdf.getCoefNorm(i, intCoefSet);
+    if (coef!=0) result+=coef*vals[i];
+  }
+  return result;
+}
@@ -23,17 +23,27 @@
 #include <iostream>
 #include <fstream>
 #include "Riostream.h"
+#include <iomanip>
 #include <sstream>
+#include <vector>
 
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "TFile.h"
 #include "TMD5.h"
+#include "TSystem.h"
 
 #include "Roo1DTable.h"
+#include "RooAbsCategory.h"
 #include "RooArgList.h"
 #include "RooDataSet.h"
+#include "RooFormulaVar.h"
 #include "RooRealVar.h"
 #include "RooStringVar.h"
 
 #include "rarDatasets.hh"
+#include "rarFingerprint.hh"
 
 ClassImp(rarDatasets)
   ;
@@ -69,6 +79,7 @@ rarDatasets::rarDatasets(const char *configFile, const char *configSec,
 rarDatasets::~rarDatasets()
 {
   // _dataSets.Delete();
+  _lazyDataSets.Delete();
 }
 
 /// \brief Initial function called by ctor
@@ -127,21 +138,30 @@ void rarDatasets::init()
     std::cout<<Form(" dataset%02d ",i)<<datasetsStrParser[i]<<" "<<datasetStr<<std::endl;
   }
   std::cout<<std::endl;
-  // now read in the datasets
+  // read in datasets only when needed?
+  TString lazyStr=readConfStr("lazyDatasets", "notSet", _actionSec);
+  if ("notSet"==lazyStr) lazyStr=readConfStr("lazyDatasets", "no");
+  Bool_t lazy=("yes"==lazyStr);
   for (Int_t i=0; i<nDataset; i++) {
-    Bool_t isUB=kFALSE;
     TString datasetStr=(RooStringVar&)datasetList[datasetsStrParser[i]];
-    // get name of weight variable
-    TString wgtVarName = getWeightVarName(getDSName(datasetsStrParser[i]));
-
-    RooDataSet *data=createDataSet(datasetsStrParser[i]+" "+datasetStr, isUB, wgtVarName);
-    data->SetName(getDSName(datasetsStrParser[i]));
-    _dataSets.Add(data);
-    if (isUB) ubStr(getDSName(datasetsStrParser[i]), "Unblinded");
-    //data->Print("v");
-    //data->get()->Print("v");
+    _lazyDataSets.Add(new TNamed(getDSName(datasetsStrParser[i]),
+                                 datasetsStrParser[i]+" "+datasetStr));
   }
-
+  if (lazy) {
+    std::cout<<"Datasets will be read in when needed"<<std::endl<<std::endl;
+    return;
+  }
+  // read in primary datasets in parallel?
+  TString nProcStr=readConfStr("parallelDatasets", "notSet", _actionSec);
+  if ("notSet"==nProcStr) nProcStr=readConfStr("parallelDatasets", "1");
+  Int_t nProc=atoi(nProcStr);
+  if (nProc>1) preloadDataSets(nProc);
+  // now read in the datasets
+  for (Int_t i=0; i<nDataset; i++)
+    readDataSet(getDSName(datasetsStrParser[i]), kFALSE);
+  if (""!=_preloadDir) gSystem->Unlink(_preloadDir);
+  _preloadDir="";
+  
   std::cout<<std::endl<<"Datasets read in:"<<std::endl;
   _dataSets.Print();
   std::cout<<std::endl;
@@ -150,6 +170,277 @@ void rarDatasets::init()
   tabulateDatasets();
 }
 
+/// \brief Read in a configured dataset
+/// \param dsName The name of the dataset
+/// \param tabulate Tabulate it if configured
+/// \return The dataset read in, or null if not configured (or read in)
+///
+/// It creates the dataset by calling #createDataSet
+/// and moves it from #_lazyDataSets to #_dataSets.
+/// With config \p lazyDatasets = \p yes
+/// (in action section, or dataset input section),
+/// it is called by #getData for the datasets really used,
+/// so eg, toy studies without embedding do not read in any dataset.
+RooDataSet *rarDatasets::readDataSet(TString dsName, Bool_t tabulate)
+{
+  TNamed *dsStr=(TNamed*)_lazyDataSets.FindObject(dsName);
+  if (!dsStr) return 0;
+  Bool_t isUB=kFALSE;
+  RooDataSet *data(0);
+  // get name of weight variable
+  TString wgtVarName = getWeightVarName(dsName);
+  // read in by #preloadDataSets?
+  TString preloadFile=_preloadDir+"/"+dsName+".root";
+  TString fingerprint("");
+  if ((""!=_preloadDir)&&!gSystem->AccessPathName(preloadFile)) {
+    data=readDataSetFile(preloadFile, dsName, &fingerprint);
+    gSystem->Unlink(preloadFile);
+  }
+  // in dataset cache?
+  TString cacheFile=getCacheFile(dsStr->GetTitle(), wgtVarName);
+  if (!data&&(""!=cacheFile)&&!gSystem->AccessPathName(cacheFile)) {
+    data=readDataSetFile(cacheFile, dsName, &fingerprint);
+    if (data) std::cout<<" Dataset "<<dsName<<" read in from cache "
+                       <<cacheFile<<std::endl;
+  }
+  if (!data) {
+    data=createDataSet(dsStr->GetTitle(), isUB, wgtVarName, &fingerprint);
+    data->SetName(dsName);
+    if (""!=cacheFile) writeDataSetFile(data, cacheFile, fingerprint);
+  }
+  data->SetName(dsName);
+  _dataSets.Add(data);
+  if (""!=fingerprint) setFingerprint(data, fingerprint);
+  _lazyDataSets.Remove(dsStr);
+  delete dsStr;
+  if (isUB) ubStr(dsName, "Unblinded");
+  //data->Print("v");
+  //data->get()->Print("v");
+  if (tabulate) {
+    std::cout<<" Dataset read in"<<std::endl;
+    data->Print();
+    tabulateDatasets(dsName);
+  }
+  
+  return data;
+}
+
+/// \brief Wait for one of the processes reading in datasets
+/// \param pids Pids of running processes
+/// \param files Their dataset files
+///
+/// It reaps the first process of \p pids found finished
+/// (other children are left alone),
+/// and removes its file if it did not exit normally,
+/// so that the dataset is created by rarDatasets::readDataSet.
+static void rarWaitPreload(std::vector<pid_t> &pids,
+                           std::vector<TString> &files)
+{
+  while (pids.size()>0) {
+    for (UInt_t i=0; i<pids.size(); i++) {
+      int status(0);
+      pid_t ret=waitpid(pids[i], &status, WNOHANG);
+      if (0==ret) continue;
+      if ((ret>0)&&(!WIFEXITED(status)||WEXITSTATUS(status))) {
+        std::cout<<" Process "<<pids[i]<<" for "<<files[i]
+                 <<" failed"<<std::endl;
+        gSystem->Unlink(files[i]);
+      }
+      pids.erase(pids.begin()+i);
+      files.erase(files.begin()+i);
+      return;
+    }
+    gSystem->Sleep(10);
+  }
+}
+
+/// \brief Read in primary datasets in parallel
+/// \param nProc Max number of processes
+///
+/// With config \p parallelDatasets = \p nProc (>1)
+/// (in action section, or dataset input section),
+/// the \p ascii and \p root datasets, which do not depend on each other,
+/// are read in by up to \p nProc forked processes,
+/// each writing its dataset to a temporary ROOT file.
+/// #readDataSet then reads those files back in config order,
+/// and creates the derived datasets (\p add, \p reduce, \p hist)
+/// after their inputs, as before.
+/// A dataset whose process fails is created by #readDataSet itself.
+/// Every primary dataset read in this way is written to
+/// the temporary dir (\p TMPDIR, or \p /tmp) first,
+/// so it needs as much free space there as the datasets take.
+void rarDatasets::preloadDataSets(Int_t nProc)
+{
+  _preloadDir=Form("%s/rarDatasets_%d", gSystem->TempDirectory(),
+                   gSystem->GetPid());
+  if (gSystem->mkdir(_preloadDir, kTRUE)) {
+    std::cout<<" Can not create dir "<<_preloadDir<<std::endl;
+    _preloadDir="";
+    return;
+  }
+  std::cout<<"Reading in datasets with "<<nProc<<" processes"<<std::endl;
+  std::vector<pid_t> pids; // running processes
+  std::vector<TString> files; // and their files
+  for (Int_t i=0; i<_lazyDataSets.GetSize(); i++) {
+    TNamed *dsStr=(TNamed*)_lazyDataSets.At(i);
+    rarStrParser dsStrParser=dsStr->GetTitle();
+    if ((dsStrParser.nArgs()<2)||
+        (("ascii"!=dsStrParser[1])&&("root"!=dsStrParser[1]))) continue;
+    TString dsName=dsStr->GetName();
+    TString wgtVarName=getWeightVarName(dsName);
+    // cached datasets are read in by #readDataSet
+    TString cacheFile=getCacheFile(dsStr->GetTitle(), wgtVarName);
+    if ((""!=cacheFile)&&!gSystem->AccessPathName(cacheFile)) continue;
+    // wait for a free slot
+    if ((Int_t)pids.size()>=nProc) rarWaitPreload(pids, files);
+    std::cout.flush();
+    pid_t pid=fork();
+    if (pid<0) break; // the rest are read in by readDataSet
+    if (0==pid) { // child
+      Bool_t isUB=kFALSE;
+      TString fingerprint("");
+      RooDataSet *data=createDataSet(dsStr->GetTitle(), isUB, wgtVarName,
+                                     &fingerprint);
+      data->SetName(dsName);
+      if (""!=cacheFile) writeDataSetFile(data, cacheFile, fingerprint);
+      writeDataSetFile(data, _preloadDir+"/"+dsName+".root", fingerprint);
+      std::cout.flush();
+      _exit(0);
+    }
+    pids.push_back(pid);
+    files.push_back(_preloadDir+"/"+dsName+".root");
+  }
+  // wait for all of them
+  while (pids.size()>0) rarWaitPreload(pids, files);
+}
+
+/// \brief Get dataset cache file for a primary dataset
+/// \param dsStr Config string of the dataset
+/// \param wgtVarName Name of weight variable
+/// \return Cache file name, empty if not cached
+///
+/// With config \p datasetCache = \p yes in dataset input section,
+/// \p ascii and \p root datasets, as created by #createDataSet
+/// (after cuts, AddOns columns and weights),
+/// are kept in ROOT files in \p datasetCacheDir
+/// (default \p .datasetCache),
+/// and read in from there by later runs.
+/// The file name is the MD5 hash of the dataset config
+/// (source files, tree name, cut, etc.),
+/// the size and modification time of the source files,
+/// the configs of the dataset definition section
+/// (fields, AddOns, ranges, categories),
+/// and the weight variable.
+TString rarDatasets::getCacheFile(TString dsStr, TString wgtVarName)
+{
+  if ("yes"!=readConfStr("datasetCache", "no")) return "";
+  rarStrParser dsStrParser=dsStr;
+  if (dsStrParser.nArgs()<4) return "";
+  TString dsType=dsStrParser[1];
+  if (("ascii"!=dsType)&&("root"!=dsType)) return "";
+  
+  std::stringstream keyStr;
+  keyStr<<std::setprecision(17);
+  // dataset config, w/o name and title
+  for (Int_t i=1; i<dsStrParser.nArgs(); i++)
+    if (2!=i) keyStr<<dsStrParser[i]<<std::endl;
+  keyStr<<wgtVarName<<std::endl;
+  // source files
+  TString commonPath("");
+  if (("ascii"==dsType)&&(dsStrParser.nArgs()>5)) commonPath=dsStrParser[5];
+  TString fileList=dsStrParser[3];
+  if ("ascii"==dsType) fileList.ReplaceAll(",", " ");
+  rarStrParser fileParser=fileList;
+  for (Int_t i=0; i<fileParser.nArgs(); i++) {
+    TString fileName=fileParser[i];
+    if (fileName.Contains(":")) fileName.Remove(0, fileName.Last(':')+1);
+    fileName=commonPath+fileName; // as RooDataSet::read
+    FileStat_t fileStat;
+    if (gSystem->GetPathInfo(fileName, fileStat)) return "";
+    keyStr<<fileName<<" "<<fileStat.fSize<<" "<<fileStat.fMtime<<std::endl;
+  }
+  // observable schema
+  const rarConfStore *theStore=indexConfFile(_configFile);
+  rarConfStore::const_iterator theSec;
+  if (!theStore||(theStore->end()==(theSec=theStore->find
+      (std::string(Form("[%s]", _dsd->getVarSec().Data())))))) {
+    // not indexed, use full obs
+    RooArgList obsList(*_fullObs);
+    for (Int_t i=0; i<obsList.getSize(); i++)
+      obsList.at(i)->printStream(keyStr, RooPrintable::kClassName|
+                                 RooPrintable::kName|RooPrintable::kTitle|
+                                 RooPrintable::kArgs|RooPrintable::kExtras,
+                                 RooPrintable::kSingleLine);
+  } else {
+    for (std::map<std::string, std::string>::const_iterator
+           it=theSec->second.begin(); it!=theSec->second.end(); ++it)
+      keyStr<<it->first<<" = "<<it->second<<std::endl;
+  }
+  
+  TMD5 md5;
+  std::string theKeyStr=keyStr.str();
+  md5.Update((UChar_t*)theKeyStr.c_str(), theKeyStr.length());
+  md5.Final();
+  
+  return readConfStr("datasetCacheDir", ".datasetCache")+"/"+
+    md5.AsString()+".root";
+}
+
+/// \brief Read in dataset from ROOT file
+/// \param fileName The file
+/// \param dsName The name of the dataset
+/// \param fingerprint Returned fingerprint saved with the dataset
+///        (empty if none)
+/// \return The dataset read in (in memory), null if failed
+RooDataSet *rarDatasets::readDataSetFile(TString fileName, TString dsName,
+                                         TString *fingerprint)
+{
+  if (fingerprint) *fingerprint="";
+  RooDataSet *data(0);
+  TDirectory *curDir=gDirectory;
+  TFile f(fileName);
+  RooDataSet *theData=dynamic_cast<RooDataSet*>(f.Get("rarDataset"));
+  if (theData) {
+    data=new RooDataSet(*theData, dsName);
+    delete theData;
+    TNamed *theFingerprint=dynamic_cast<TNamed*>(f.Get("rarFingerprint"));
+    if (theFingerprint&&fingerprint) *fingerprint=theFingerprint->GetTitle();
+    delete theFingerprint;
+  }
+  f.Close();
+  if (curDir) curDir->cd();
+  
+  return data;
+}
+
+/// \brief Write out dataset to ROOT file
+/// \param data The dataset
+/// \param fileName The file
+/// \param fingerprint The fingerprint of the dataset, saved if known
+///
+/// The file is written under a temporary name first and then renamed,
+/// so other processes never see a partial file.
+void rarDatasets::writeDataSetFile(RooDataSet *data, TString fileName,
+                                   TString fingerprint)
+{
+  TString dirName=gSystem->DirName(fileName);
+  if (gSystem->AccessPathName(dirName)&&gSystem->mkdir(dirName, kTRUE)) {
+    std::cout<<" Can not create dir "<<dirName<<std::endl;
+    return;
+  }
+  TString tmpFile=Form("%s.%d.tmp", fileName.Data(), gSystem->GetPid());
+  TDirectory *curDir=gDirectory;
+  TFile f(tmpFile, "recreate");
+  data->Write("rarDataset");
+  if (""!=fingerprint) {
+    TNamed theFingerprint("rarFingerprint", fingerprint);
+    theFingerprint.Write();
+  }
+  f.Close();
+  if (curDir) curDir->cd();
+  gSystem->Rename(tmpFile, fileName);
+}
+
 /// \brief return the name of the weighted variable to be used in this dataset
 ///
 /// It sets weight var according to configs
@@ -231,25 +522,38 @@ TString rarDatasets::getDSName(TString name)
 /// \param name The name of the dataset to return
 /// \return The returned dataset
 ///
-/// It first checks if dataset named \p name exsits in #_dataSets,
+/// It first checks if dataset named \p name exsits in #_dataSets
+/// (or is configured but not read in yet, see #readDataSet),
 /// if yes, it returns the dataset,
 /// if no, it parses \p name and if the number of tokens
 /// is greater than 0, it will check if there is dataset named
 /// as the first token, if yes, it will reduce that dataset
 /// according to the second token and return the reduced dataset.
 /// Otherwise, it returns null.
+/// The subset is filled in one pass over the events of that dataset,
+/// and it is kept in #_dataSets, so later calls just return it.
 RooDataSet *rarDatasets::getData(const char *name)
 {
   RooDataSet *theData=(RooDataSet*)_dataSets.FindObject(getDSName(name));
   if (theData) return theData;
+  // not read in yet?
+  if ((theData=readDataSet(getDSName(name)))) return theData;
   // can not find the data set parser the name
   rarStrParser nameParser=name;
   if (nameParser.nArgs()<=0) return theData;
   theData=(RooDataSet*)_dataSets.FindObject(getDSName(nameParser[0]));
+  if (!theData) theData=readDataSet(getDSName(nameParser[0]));
   if (!theData) return theData; //can not find any
   // reduce the dataset
-  theData=(RooDataSet*)theData->reduce(nameParser[1]);
-  theData->SetName(getDSName(name));
+  RooDataSet *srcData=theData;
+  theData=(RooDataSet*)srcData->emptyClone(getDSName(name),
+                                           srcData->GetTitle());
+  RooFormulaVar cutVar("cutVar", nameParser[1], *srcData->get());
+  Int_t nEvt=srcData->numEntries();
+  for (Int_t i=0; i<nEvt; i++) {
+    const RooArgSet *theEvt=srcData->get(i);
+    if (cutVar.getVal()) theData->add(*theEvt, srcData->weight());
+  }
   _dataSets.Add(theData);
   // check if need to set ub bit
   if (!isBlind(getDSName(nameParser[0]))) {
@@ -268,6 +572,13 @@ RooDataSet *rarDatasets::getData(const char *name)
 /// \param dsName The name of the dataset
 /// \param ubStrVal The ubStr value (to set)
 /// \return The unblind string for the dataset
+///
+/// By default, it is the MD5 hash of sampled events written as text.
+/// With config \p ubHash = \p binary in dataset input section,
+/// it is the binary fingerprint of the dataset (see #getFingerprint),
+/// which covers every event rather than a sample,
+/// but differs from the text hash,
+/// so \p ub_ configs have to be updated when switching.
 TString rarDatasets::ubStr(TString dsName, const char *ubStrVal)
 {
   TString ubStrName="ub_"+dsName;
@@ -295,6 +606,11 @@ TString rarDatasets::ubStr(TString dsName, const char *ubStrVal)
         <<" Can not find dataset named "<<dsName<<" for ub calculation!"<<std::endl;
     return theStr->getVal();
   }
+  // use binary fingerprint?
+  if ("binary"==readConfStr("ubHash", "text")) {
+    theStr->setVal(getFingerprint(theData));
+    return theStr->getVal();
+  }
   Int_t nEvt=theData->numEntries();
   Int_t nStep=nEvt/10000;
   nStep++;
@@ -312,6 +628,41 @@ TString rarDatasets::ubStr(TString dsName, const char *ubStrVal)
   return theStr->getVal();
 }
 
+/// \brief Return the binary fingerprint of a dataset
+/// \param data The dataset
+/// \return The fingerprint (see rarFingerprint)
+///
+/// For datasets held, it is kept once known.
+/// It is known without an extra pass over the events
+/// for datasets read in by rarAsciiReader, and for datasets
+/// read in from the dataset cache or by #preloadDataSets
+/// when it was known as they were written;
+/// for others, it takes one pass over the events the first time.
+/// It can be used by any cache keyed by dataset content.
+TString rarDatasets::getFingerprint(RooDataSet *data)
+{
+  std::map<const RooDataSet*, TString>::const_iterator it=
+    _fingerprints.find(data);
+  if (it!=_fingerprints.end()) return it->second;
+  
+  TString fingerprint=rarFingerprint::compute(data);
+  setFingerprint(data, fingerprint);
+  
+  return fingerprint;
+}
+
+/// \brief Set the fingerprint of a dataset
+/// \param data The dataset
+/// \param fingerprint The fingerprint (see #getFingerprint)
+///
+/// It is kept only for datasets held in #_dataSets,
+/// which live as long as this object.
+void rarDatasets::setFingerprint(RooDataSet *data, TString fingerprint)
+{
+  if (!_dataSets.FindObject(data)) return;
+  _fingerprints[data]=fingerprint;
+}
+
 /// \brief Check if the named dataset is blind or not
 /// \param dsName The name of the dataset
 /// \return Boolean for blind (true) or unblind (false)
@@ -31,6 +31,8 @@
 #include "RooBDecay.h"
 #include "RooDecay.h"
 
+#include "RooRarBCPGenDecay.hh"
+#include "RooRarDecay.hh"
 #include "rarDecay.hh"
 
 ClassImp(rarDecay)
@@ -195,8 +197,20 @@ void rarDecay::init()
     bcpGenDecayType=RooBCPGenDecay::Flipped;
   }
   
+  // per-event cache of convolved basis functions?
+  Bool_t convCache=("yes"==readConfStr("convCache", "no", getVarSec()));
+  Int_t convCacheSlots=atoi(readConfStr("convCacheSlots", "1000000",
+                                        getVarSec()));
+  
   // create pdf
-  if ("BCPGenDecay"==_pdfType) {
+  if (convCache&&("BCPGenDecay"==_pdfType)) {
+    _thePdf=new
+      RooRarBCPGenDecay(Form("the_%s",GetName()), _pdfType+" "+GetTitle(),
+                        *_x, *_tag, *_tau, *_dm, *_w, *_Cb, *_Sb, *_dw, *_mu,
+                        *((RooResolutionModel*)_model->getPdf()),
+                        bcpGenDecayType);
+    ((RooRarBCPGenDecay*)_thePdf)->setCacheSlots(convCacheSlots);
+  } else if ("BCPGenDecay"==_pdfType) {
     _thePdf=new
       RooBCPGenDecay(Form("the_%s",GetName()), _pdfType+" "+GetTitle(),
                      *_x, *_tag, *_tau, *_dm, *_w, *_Cb, *_Sb, *_dw, *_mu,
@@ -205,6 +219,12 @@ void rarDecay::init()
     _thePdf=new RooBDecay(Form("the_%s",GetName()), _pdfType+" "+GetTitle(),
 			  *_x, *_tau, *_dgamma, *_f0, *_f1, *_f2, *_f3, *_dm,
 			  *((RooResolutionModel*)_model->getPdf()),bDecayType);
+  } else if (convCache) {
+    _thePdf=new RooRarDecay(Form("the_%s",GetName()), _pdfType+" "+GetTitle(),
+                            *_x, *_tau,
+                            *((RooResolutionModel*)_model->getPdf()),
+                            decayType);
+    ((RooRarDecay*)_thePdf)->setCacheSlots(convCacheSlots);
   } else {
     _thePdf=new RooDecay(Form("the_%s",GetName()), _pdfType+" "+GetTitle(),
 			 *_x, *_tau,
@@ -0,0 +1,525 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides binned adaptive kernel density estimator
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides binned adaptive kernel density estimator
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include <iomanip>
+#include <sstream>
+using namespace std;
+
+#include "TArrayI.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TMD5.h"
+#include "TMath.h"
+#include "TSystem.h"
+
+#include "RooAbsReal.h"
+#include "RooArgSet.h"
+#include "RooDataSet.h"
+
+#include "rarFFTKeys.hh"
+
+ClassImp(rarFFTKeys)
+  ;
+
+/// Maximum number of adaptive bandwidth classes
+static const Int_t rarFFTKeysMaxClasses=64;
+/// Bandwidth ratio between adjacent classes
+static const Double_t rarFFTKeysClassRatio=1.05;
+
+/// \brief Default ctor
+///
+/// \param nBins Number of table bins (per axis) in range
+/// \param rho Width scale factor
+/// \param option Mirror option (1D) or Roo2DKeysPdf options (2D)
+/// \param cacheDir Directory of table cache (empty for no cache)
+rarFFTKeys::rarFFTKeys(Int_t nBins, Double_t rho, TString option,
+                       TString cacheDir)
+  : TObject(), _nBins(nBins), _rho(rho), _option(option),
+    _cacheDir(cacheDir),
+    _nx(0), _ny(0), _pad(0), _gxLo(0), _gyLo(0), _dx(1), _dy(1)
+{
+  if (_nBins<2) _nBins=2;
+}
+
+rarFFTKeys::~rarFFTKeys()
+{
+}
+
+/// \brief Build Keys table
+/// \param data The dataset
+/// \param xName Name of x in the dataset
+/// \param xlo Low edge of x
+/// \param xhi High edge of x
+/// \param yName Name of y in the dataset (0 for 1D)
+/// \param ylo Low edge of y
+/// \param yhi High edge of y
+/// \return The table (TH1D or TH2D) of probability per bin,
+///         owned by the caller
+///
+/// The table is restored from the cache if the events and options
+/// are the same, otherwise it is built and written to the cache.
+TH1 *rarFFTKeys::build(RooDataSet &data, const char *xName, Double_t xlo,
+                       Double_t xhi, const char *yName, Double_t ylo,
+                       Double_t yhi)
+{
+  Bool_t is2D=(0!=yName);
+  TArrayD xs, ys, ws;
+  Int_t nPts=loadData(data, xName, yName, xs, ys, ws);
+  TString cacheKey;
+  if (""!=_cacheDir) {
+    cacheKey=getCacheKey(xs, ys, ws, xlo, xhi, ylo, yhi, is2D);
+    TH1 *table=readCache(cacheKey);
+    if (table) {
+      cout<<" Keys table for "<<data.GetName()
+          <<" restored from cache "<<cacheKey<<endl;
+      return table;
+    }
+  }
+  
+  // padded grid
+  Int_t n=_nBins;
+  _pad=n/2;
+  _nx=n+2*_pad;
+  _dx=(xhi-xlo)/n;
+  _gxLo=xlo-_pad*_dx;
+  _ny=1;
+  _dy=1;
+  _gyLo=-.5;
+  if (is2D) {
+    _ny=_nx;
+    _dy=(yhi-ylo)/n;
+    _gyLo=ylo-_pad*_dy;
+  }
+  
+  // weighted mean and sigma
+  Double_t sumW(0), sumX(0), sumXX(0), sumY(0), sumYY(0);
+  for (Int_t i=0; i<nPts; i++) {
+    sumW+=ws[i];
+    sumX+=ws[i]*xs[i];
+    sumXX+=ws[i]*xs[i]*xs[i];
+    if (!is2D) continue;
+    sumY+=ws[i]*ys[i];
+    sumYY+=ws[i]*ys[i]*ys[i];
+  }
+  if (sumW<=0) {
+    cout<<" No events in "<<data.GetName()<<" to build Keys table"<<endl;
+    exit(-1);
+  }
+  Double_t xVar=sumXX/sumW-(sumX/sumW)*(sumX/sumW);
+  Double_t yVar=sumYY/sumW-(sumY/sumW)*(sumY/sumW);
+  Double_t xSigma=xVar>0?sqrt(xVar):0;
+  Double_t ySigma=yVar>0?sqrt(yVar):0;
+  
+  // fixed bandwidths (in cells) and per-event scale
+  const Double_t *yArr=is2D?ys.GetArray():0;
+  Double_t hx(0), hy(0);
+  TArrayD lambda(nPts);
+  for (Int_t i=0; i<nPts; i++) lambda[i]=1;
+  TArrayD pilot(_nx*_ny);
+  if (!is2D) {
+    // same widths as RooKeysPdf
+    Double_t h=TMath::Power(4./3., .2)*TMath::Power(sumW, -.2)*_rho;
+    hx=h*xSigma/_dx;
+    Double_t hmin=h*xSigma*sqrt(2.)/10;
+    Double_t norm=h*sqrt(xSigma)/(2.*sqrt(3.));
+    binLinear(nPts, xs.GetArray(), yArr, ws.GetArray(), 0, 0, pilot);
+    smooth(pilot, hx, 0);
+    for (Int_t i=0; (hx>0)&&(i<nPts); i++) {
+      Double_t f=interpolate(pilot, xs[i], 0)/(sumW*_dx);
+      Double_t w=(f>0)?norm/sqrt(f):_pad*_dx;
+      if (w<hmin) w=hmin;
+      lambda[i]=w/(hx*_dx);
+    }
+  } else {
+    // same widths as Roo2DKeysPdf, Abramson scale for adaptive
+    Double_t n16=TMath::Power(sumW, -1./6.);
+    hx=xSigma*n16*_rho/_dx;
+    hy=ySigma*n16*_rho/_dy;
+    if (!_option.Contains("n")) {
+      binLinear(nPts, xs.GetArray(), yArr, ws.GetArray(), 0, 0, pilot);
+      smooth(pilot, hx, hy);
+      Double_t sumLogF(0), sumWF(0);
+      for (Int_t i=0; i<nPts; i++) {
+        Double_t f=interpolate(pilot, xs[i], ys[i]);
+        lambda[i]=f;
+        if (f<=0) continue;
+        sumLogF+=ws[i]*log(f);
+        sumWF+=ws[i];
+      }
+      Double_t gMean=(sumWF>0)?exp(sumLogF/sumWF):0;
+      for (Int_t i=0; i<nPts; i++)
+        lambda[i]=(lambda[i]>0)?sqrt(gMean/lambda[i]):_pad;
+    }
+  }
+  // keep the kernels within the padding
+  Double_t hMax=hx>hy?hx:hy;
+  Double_t lambdaMax=(hMax>0)?_pad/hMax:1;
+  Double_t lMin(0), lMax(0);
+  for (Int_t i=0; i<nPts; i++) {
+    if (lambda[i]>lambdaMax) lambda[i]=lambdaMax;
+    if (lambda[i]<=0) lambda[i]=1;
+    if ((0==i)||(lambda[i]<lMin)) lMin=lambda[i];
+    if ((0==i)||(lambda[i]>lMax)) lMax=lambda[i];
+  }
+  
+  // sum of fixed-bandwidth estimates over bandwidth classes
+  Int_t nClasses=1;
+  Double_t lStep(0);
+  if (lMax>lMin*rarFFTKeysClassRatio) {
+    nClasses=(Int_t)(log(lMax/lMin)/log(rarFFTKeysClassRatio))+1;
+    if (nClasses>rarFFTKeysMaxClasses) nClasses=rarFFTKeysMaxClasses;
+    lStep=log(lMax/lMin)/nClasses;
+  }
+  TArrayI cls(nPts);
+  for (Int_t i=0; i<nPts; i++) {
+    Int_t c=(lStep>0)?(Int_t)(log(lambda[i]/lMin)/lStep):0;
+    if (c<0) c=0;
+    if (c>nClasses-1) c=nClasses-1;
+    cls[i]=c;
+  }
+  TArrayD dens(_nx*_ny);
+  TArrayD tmp(_nx*_ny);
+  for (Int_t c=0; c<nClasses; c++) {
+    binLinear(nPts, xs.GetArray(), yArr, ws.GetArray(), cls.GetArray(), c,
+              tmp);
+    if (tmp.GetSum()==0) continue;
+    Double_t l=lMin*exp((c+.5)*lStep);
+    smooth(tmp, l*hx, l*hy);
+    for (Int_t i=0; i<dens.GetSize(); i++) dens[i]+=tmp[i];
+  }
+  
+  // fold mirrored contributions back into range
+  Double_t sL(0), sR(0);
+  if (!is2D) {
+    if ("MirrorLeft"==_option) sL=1;
+    else if ("MirrorRight"==_option) sR=1;
+    else if ("MirrorBoth"==_option) sL=sR=1;
+    else if ("MirrorAsymLeft"==_option) sL=-1;
+    else if ("MirrorAsymLeftRight"==_option) {sL=-1; sR=1;}
+    else if ("MirrorAsymRight"==_option) sR=-1;
+    else if ("MirrorLeftAsymRight"==_option) {sL=1; sR=-1;}
+    else if ("MirrorAsymBoth"==_option) sL=sR=-1;
+  } else if (_option.Contains("m")) sL=sR=1;
+  TH1 *table(0);
+  if (is2D) table=new TH2D("keysTable", "Keys table", n, xlo, xhi,
+                           n, ylo, yhi);
+  else table=new TH1D("keysTable", "Keys table", n, xlo, xhi);
+  table->SetDirectory(0);
+  Int_t nyRange=is2D?n:1;
+  for (Int_t iy=0; iy<nyRange; iy++) {
+    // padded cells contributing to this row, and their signs
+    Int_t yIdx[3]={is2D?_pad+iy:0, -1, -1};
+    Double_t yCoef[3]={1, 0, 0};
+    if (is2D&&(iy<_pad)) {yIdx[1]=_pad-1-iy; yCoef[1]=sL;}
+    if (is2D&&(n-1-iy<_pad)) {yIdx[2]=_pad+n+(n-1-iy); yCoef[2]=sR;}
+    for (Int_t ix=0; ix<n; ix++) {
+      Int_t xIdx[3]={_pad+ix, -1, -1};
+      Double_t xCoef[3]={1, 0, 0};
+      if (ix<_pad) {xIdx[1]=_pad-1-ix; xCoef[1]=sL;}
+      if (n-1-ix<_pad) {xIdx[2]=_pad+n+(n-1-ix); xCoef[2]=sR;}
+      Double_t v(0);
+      for (Int_t a=0; a<3; a++) {
+        if ((yIdx[a]<0)||(0==yCoef[a])) continue;
+        for (Int_t b=0; b<3; b++) {
+          if ((xIdx[b]<0)||(0==xCoef[b])) continue;
+          v+=yCoef[a]*xCoef[b]*dens[xIdx[b]+_nx*yIdx[a]];
+        }
+      }
+      if (v<0) v=0;
+      if (is2D) table->SetBinContent(ix+1, iy+1, v/sumW);
+      else table->SetBinContent(ix+1, v/sumW);
+    }
+  }
+  
+  if (""!=_cacheDir) writeCache(cacheKey, table);
+  return table;
+}
+
+/// \brief Load events from dataset
+/// \param data The dataset
+/// \param xName Name of x
+/// \param yName Name of y (0 for 1D)
+/// \param xs Values of x
+/// \param ys Values of y
+/// \param ws Weights
+/// \return Number of events
+Int_t rarFFTKeys::loadData(RooDataSet &data, const char *xName,
+                           const char *yName, TArrayD &xs, TArrayD &ys,
+                           TArrayD &ws) const
+{
+  const RooArgSet *row=data.get();
+  RooAbsReal *xVar=dynamic_cast<RooAbsReal*>(row->find(xName));
+  RooAbsReal *yVar=yName?dynamic_cast<RooAbsReal*>(row->find(yName)):0;
+  if (!xVar||(yName&&!yVar)) {
+    cout<<" Can not find "<<(xVar?yName:xName)
+        <<" in dataset "<<data.GetName()<<endl;
+    exit(-1);
+  }
+  Int_t nPts=data.numEntries();
+  xs.Set(nPts);
+  ys.Set(yVar?nPts:0);
+  ws.Set(nPts);
+  for (Int_t i=0; i<nPts; i++) {
+    data.get(i);
+    xs[i]=xVar->getVal();
+    if (yVar) ys[i]=yVar->getVal();
+    ws[i]=data.weight();
+  }
+  return nPts;
+}
+
+/// \brief Fingerprint of events and options
+/// \return MD5 of the options, ranges, and all event values and weights
+TString rarFFTKeys::getCacheKey(const TArrayD &xs, const TArrayD &ys,
+                                const TArrayD &ws, Double_t xlo,
+                                Double_t xhi, Double_t ylo, Double_t yhi,
+                                Bool_t is2D) const
+{
+  stringstream keyStr;
+  keyStr<<setprecision(17);
+  keyStr<<"rarFFTKeys "<<(is2D?2:1)<<" "<<_nBins<<" "<<_rho<<" "<<_option
+        <<" "<<xlo<<" "<<xhi<<" "<<ylo<<" "<<yhi<<" "<<xs.GetSize()<<endl;
+  TMD5 md5;
+  string theKeyStr=keyStr.str();
+  md5.Update((UChar_t*)theKeyStr.c_str(), theKeyStr.length());
+  md5.Update((UChar_t*)xs.GetArray(), xs.GetSize()*sizeof(Double_t));
+  md5.Update((UChar_t*)ys.GetArray(), ys.GetSize()*sizeof(Double_t));
+  md5.Update((UChar_t*)ws.GetArray(), ws.GetSize()*sizeof(Double_t));
+  md5.Final();
+  
+  return md5.AsString();
+}
+
+/// \brief Read table from the cache
+/// \param cacheKey The cache key
+/// \return The table found (0 if not in the cache)
+TH1 *rarFFTKeys::readCache(TString cacheKey) const
+{
+  TString cacheFile=_cacheDir+"/"+cacheKey+".root";
+  if (gSystem->AccessPathName(cacheFile)) return 0;
+  TH1 *table(0);
+  TDirectory *curDir=gDirectory;
+  TFile f(cacheFile);
+  TH1 *cachedTable=dynamic_cast<TH1*>(f.Get("keysTable"));
+  if (cachedTable) {
+    table=(TH1*)cachedTable->Clone("keysTable");
+    table->SetDirectory(0);
+  }
+  f.Close();
+  if (curDir) curDir->cd();
+  return table;
+}
+
+/// \brief Write table to the cache
+/// \param cacheKey The cache key
+/// \param table The table
+void rarFFTKeys::writeCache(TString cacheKey, TH1 *table) const
+{
+  if (gSystem->AccessPathName(_cacheDir)&&gSystem->mkdir(_cacheDir, kTRUE)) {
+    cout<<" Can not create Keys cache dir "<<_cacheDir<<endl;
+    return;
+  }
+  TString cacheFile=_cacheDir+"/"+cacheKey+".root";
+  TDirectory *curDir=gDirectory;
+  TFile f(cacheFile, "recreate");
+  table->Write("keysTable");
+  f.Close();
+  if (curDir) curDir->cd();
+}
+
+/// \brief Bin events linearly on the padded grid
+/// \param nPts Number of events
+/// \param xs Values of x
+/// \param ys Values of y (0 for 1D)
+/// \param ws Weights
+/// \param sel Class of each event (0 for all events)
+/// \param iSel Class to bin
+/// \param grid The grid to fill
+///
+/// Each weight is shared among the (2 or 4) nearest cell centers.
+void rarFFTKeys::binLinear(Int_t nPts, const Double_t *xs, const Double_t *ys,
+                           const Double_t *ws, const Int_t *sel, Int_t iSel,
+                           TArrayD &grid) const
+{
+  grid.Set(_nx*_ny);
+  grid.Reset();
+  for (Int_t i=0; i<nPts; i++) {
+    if (sel&&(sel[i]!=iSel)) continue;
+    Double_t fx=(xs[i]-_gxLo)/_dx-.5;
+    Double_t fy=ys?(ys[i]-_gyLo)/_dy-.5:0;
+    Int_t ix=(Int_t)floor(fx);
+    Int_t iy=(Int_t)floor(fy);
+    Double_t tx=fx-ix;
+    Double_t ty=fy-iy;
+    for (Int_t b=0; b<(ys?2:1); b++) {
+      Int_t jy=iy+b;
+      if ((jy<0)||(jy>=_ny)) continue;
+      Double_t wy=ys?(b?ty:1-ty):1;
+      for (Int_t a=0; a<2; a++) {
+        Int_t jx=ix+a;
+        if ((jx<0)||(jx>=_nx)) continue;
+        grid[jx+_nx*jy]+=ws[i]*wy*(a?tx:1-tx);
+      }
+    }
+  }
+}
+
+/// \brief Interpolate grid linearly between cell centers
+/// \param grid The grid
+/// \param x Value of x
+/// \param y Value of y (ignored for 1D)
+/// \return Interpolated grid value
+Double_t rarFFTKeys::interpolate(const TArrayD &grid, Double_t x,
+                                 Double_t y) const
+{
+  Double_t fx=(x-_gxLo)/_dx-.5;
+  Double_t fy=(_ny>1)?(y-_gyLo)/_dy-.5:0;
+  Int_t ix=(Int_t)floor(fx);
+  Int_t iy=(Int_t)floor(fy);
+  Double_t tx=fx-ix;
+  Double_t ty=fy-iy;
+  Double_t v(0);
+  for (Int_t b=0; b<((_ny>1)?2:1); b++) {
+    Int_t jy=iy+b;
+    if ((jy<0)||(jy>=_ny)) continue;
+    Double_t wy=(_ny>1)?(b?ty:1-ty):1;
+    for (Int_t a=0; a<2; a++) {
+      Int_t jx=ix+a;
+      if ((jx<0)||(jx>=_nx)) continue;
+      v+=grid[jx+_nx*jy]*wy*(a?tx:1-tx);
+    }
+  }
+  return v;
+}
+
+/// \brief Smooth grid with Gaussian kernel
+/// \param grid The grid
+/// \param sx Kernel sigma in x (cells)
+/// \param sy Kernel sigma in y (cells)
+///
+/// The kernel is separable, so rows and columns are convolved in turn.
+void rarFFTKeys::smooth(TArrayD &grid, Double_t sx, Double_t sy) const
+{
+  TArrayD spec;
+  Int_t nFFT(1);
+  while (nFFT<2*_nx) nFFT*=2;
+  kernelSpectrum(nFFT, sx, spec);
+  for (Int_t iy=0; iy<_ny; iy++)
+    smoothLine(grid.GetArray()+_nx*iy, _nx, 1, spec);
+  if (_ny<2) return;
+  nFFT=1;
+  while (nFFT<2*_ny) nFFT*=2;
+  kernelSpectrum(nFFT, sy, spec);
+  for (Int_t ix=0; ix<_nx; ix++)
+    smoothLine(grid.GetArray()+ix, _ny, _nx, spec);
+}
+
+/// \brief Convolve one line of grid with kernel
+/// \param a First element of the line
+/// \param n Number of elements
+/// \param stride Distance between elements
+/// \param spec Kernel spectrum
+///
+/// The line is zero padded to the spectrum size, so there is no wrap around.
+void rarFFTKeys::smoothLine(Double_t *a, Int_t n, Int_t stride,
+                            const TArrayD &spec) const
+{
+  Int_t nFFT=spec.GetSize();
+  TArrayD re(nFFT), im(nFFT);
+  Bool_t empty(kTRUE);
+  for (Int_t i=0; i<n; i++) {
+    re[i]=a[i*stride];
+    if (0!=re[i]) empty=kFALSE;
+  }
+  if (empty) return;
+  fft(nFFT, re.GetArray(), im.GetArray(), kFALSE);
+  for (Int_t i=0; i<nFFT; i++) {
+    re[i]*=spec[i];
+    im[i]*=spec[i];
+  }
+  fft(nFFT, re.GetArray(), im.GetArray(), kTRUE);
+  for (Int_t i=0; i<n; i++) a[i*stride]=re[i]/nFFT;
+}
+
+/// \brief Spectrum of sampled Gaussian kernel
+/// \param nFFT Size of the transform
+/// \param sigma Kernel sigma (cells)
+/// \param spec The spectrum (real, as the kernel is symmetric)
+///
+/// The sampled kernel is normalized to unit sum, so the smoothing
+/// conserves the total weight; a vanishing sigma gives the identity.
+void rarFFTKeys::kernelSpectrum(Int_t nFFT, Double_t sigma,
+                                TArrayD &spec) const
+{
+  TArrayD re(nFFT), im(nFFT);
+  re[0]=1;
+  Double_t sum(1);
+  for (Int_t j=1; (sigma>1e-3)&&(j<nFFT/2); j++) {
+    Double_t r=j/sigma;
+    if (r>40) break;
+    Double_t k=exp(-.5*r*r);
+    re[j]=re[nFFT-j]=k;
+    sum+=2*k;
+  }
+  for (Int_t j=0; j<nFFT; j++) re[j]/=sum;
+  fft(nFFT, re.GetArray(), im.GetArray(), kFALSE);
+  spec=re;
+}
+
+/// \brief In-place radix-2 complex FFT
+/// \param n Size (power of 2)
+/// \param re Real parts
+/// \param im Imaginary parts
+/// \param inverse True for inverse transform (not normalized)
+void rarFFTKeys::fft(Int_t n, Double_t *re, Double_t *im, Bool_t inverse)
+{
+  // bit reversal
+  for (Int_t i=1, j=0; i<n; i++) {
+    Int_t bit=n>>1;
+    for (; j&bit; bit>>=1) j^=bit;
+    j^=bit;
+    if (i<j) {
+      Double_t t=re[i]; re[i]=re[j]; re[j]=t;
+      t=im[i]; im[i]=im[j]; im[j]=t;
+    }
+  }
+  // butterflies
+  for (Int_t len=2; len<=n; len<<=1) {
+    Double_t ang=2*TMath::Pi()/len*(inverse?1:-1);
+    Double_t wRe=cos(ang), wIm=sin(ang);
+    for (Int_t i=0; i<n; i+=len) {
+      Double_t uRe(1), uIm(0);
+      for (Int_t j=0; j<len/2; j++) {
+        Int_t p=i+j, q=i+j+len/2;
+        Double_t vRe=re[q]*uRe-im[q]*uIm;
+        Double_t vIm=re[q]*uIm+im[q]*uRe;
+        re[q]=re[p]-vRe; im[q]=im[p]-vIm;
+        re[p]+=vRe; im[p]+=vIm;
+        Double_t t=uRe*wRe-uIm*wIm;
+        uIm=uRe*wIm+uIm*wRe;
+        uRe=t;
+      }
+    }
+  }
+}
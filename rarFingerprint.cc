@@ -0,0 +1,123 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides binary fingerprint of dataset content
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides binary fingerprint of dataset content
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "RooAbsCategory.h"
+#include "RooAbsReal.h"
+#include "RooArgList.h"
+#include "RooArgSet.h"
+#include "RooDataSet.h"
+
+#include "rarFingerprint.hh"
+
+using namespace std;
+
+ClassImp(rarFingerprint)
+  ;
+
+/// \brief Default ctor
+/// \param cols Columns, in the order of the values given to #addRow
+/// \param wgtVarName Column holding the weight (none if not set)
+///
+/// It hashes the sorted column names
+/// (the weight column is hashed as weight, after them).
+rarFingerprint::rarFingerprint(const RooArgList &cols, const char *wgtVarName)
+  : TObject(), _wgtIdx(-1), _nRows(0), _fingerprint("")
+{
+  TString wgtName=wgtVarName?wgtVarName:"";
+  vector<pair<string, Int_t> > names;
+  for (Int_t i=0; i<cols.getSize(); i++) {
+    if ((""!=wgtName)&&(wgtName==cols.at(i)->GetName())) _wgtIdx=i;
+    else names.push_back(make_pair(string(cols.at(i)->GetName()), i));
+  }
+  sort(names.begin(), names.end());
+  _order.Set(names.size());
+  _row.Set(names.size()+1);
+  string header;
+  for (UInt_t i=0; i<names.size(); i++) {
+    _order[i]=names[i].second;
+    header+=names[i].first+"\n";
+  }
+  header+="weight\n";
+  _md5.Update((UChar_t*)header.c_str(), header.length());
+}
+
+rarFingerprint::~rarFingerprint()
+{
+}
+
+/// \brief Add an event
+/// \param vals Values of the columns (category indices for categories)
+/// \param wgt Weight, if there is no weight column
+void rarFingerprint::addRow(const Double_t *vals, Double_t wgt)
+{
+  Int_t nCols=_order.GetSize();
+  for (Int_t i=0; i<nCols; i++) _row[i]=vals[_order[i]];
+  _row[nCols]=(_wgtIdx>=0)?vals[_wgtIdx]:wgt;
+  _md5.Update((UChar_t*)_row.GetArray(), sizeof(Double_t)*(nCols+1));
+  _nRows++;
+}
+
+/// \brief Return the fingerprint
+/// \return The fingerprint of the events added
+///
+/// No event can be added after that.
+TString rarFingerprint::getFingerprint()
+{
+  if (""!=_fingerprint) return _fingerprint;
+  _md5.Update((UChar_t*)&_nRows, sizeof(_nRows));
+  _md5.Final();
+  _fingerprint=_md5.AsString();
+  return _fingerprint;
+}
+
+/// \brief Compute the fingerprint of a dataset
+/// \param data The dataset
+/// \return The fingerprint
+///
+/// It takes one pass over the events.
+TString rarFingerprint::compute(RooDataSet *data)
+{
+  RooArgList cols(*data->get());
+  Int_t nCols=cols.getSize();
+  rarFingerprint fingerprint(cols);
+  vector<RooAbsReal*> reals(nCols, (RooAbsReal*)0);
+  vector<RooAbsCategory*> cats(nCols, (RooAbsCategory*)0);
+  for (Int_t k=0; k<nCols; k++) {
+    reals[k]=dynamic_cast<RooAbsReal*>(cols.at(k));
+    if (!reals[k]) cats[k]=dynamic_cast<RooAbsCategory*>(cols.at(k));
+  }
+  vector<Double_t> vals(nCols+1);
+  Int_t nEvt=data->numEntries();
+  for (Int_t i=0; i<nEvt; i++) {
+    data->get(i);
+    for (Int_t k=0; k<nCols; k++)
+      vals[k]=reals[k]?reals[k]->getVal():(cats[k]?cats[k]->getIndex():0);
+    fingerprint.addRow(&vals[0], data->weight());
+  }
+  
+  return fingerprint.getFingerprint();
+}
@@ -0,0 +1,520 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [RooRarFit] --
+// This class provides fit driver class for RooRarFit
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides fit driver class for RooRarFit
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include <iomanip>
+#include <sstream>
+using namespace std;
+
+#include "TFile.h"
+#include "TMD5.h"
+#include "TMath.h"
+#include "TStopwatch.h"
+#include "TSystem.h"
+
+#include "RooAbsCategory.h"
+#include "RooAbsData.h"
+#include "RooAbsPdf.h"
+#include "RooArgList.h"
+#include "RooFitResult.h"
+#include "RooGlobalFunc.h"
+#include "RooMinimizer.h"
+#include "RooRandom.h"
+#include "RooRealVar.h"
+using namespace RooFit;
+
+#include "rarBudgetNLL.hh"
+#include "rarFitDriver.hh"
+
+ClassImp(rarFitDriver)
+  ;
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+///
+/// The default settings give plain \p fitTo fits.
+rarFitDriver::rarFitDriver(const char *name, const char *title)
+  : TNamed(name, title),
+    _minType(""), _minAlgo(""), _strategy(-1), _nRetries(0), _jitter(0),
+    _minCovQual(3), _maxCalls(0), _maxTime(0), _cacheDir(""), _constOpt(2),
+    _status(0), _nTries(0), _timedOut(kFALSE), _fromCache(kFALSE)
+{
+}
+
+/// \brief Trivial dtor
+rarFitDriver::~rarFitDriver()
+{
+}
+
+/// \brief Check if the fit is plain \p fitTo
+/// \return True if no minimizer, strategy, retry or budget is set
+Bool_t rarFitDriver::isPlainFit() const
+{
+  return (""==_minType)&&(_strategy<0)&&(_nRetries<=0)&&
+    (_maxCalls<=0)&&(_maxTime<=0);
+}
+
+/// \brief Fit the pdf to the dataset
+///
+/// \param pdf The pdf to fit
+/// \param data The dataset to fit
+/// \param opt Fitting options (e, m, h, q, r as for old \p fitTo)
+/// \param condObs Conditional observables
+/// \param ncpus Number of CPUs (cores) to use in fit
+/// \param minosParams Params for minos (all if not set or empty)
+/// \return The fit result object if \p opt contains \p r
+///
+/// If the fit is found in the fit cache, it restores the params
+/// from the cache without fitting.
+/// Otherwise it fits with plain \p fitTo if #isPlainFit,
+/// or it runs #minimize and retries failed attempts
+/// until one is good, the retries are used up,
+/// or the wall-time budget is exceeded.
+/// The params are left at the values of the best attempt.
+RooFitResult *rarFitDriver::fit(RooAbsPdf *pdf, RooAbsData *data, TString opt,
+                                const RooArgSet &condObs, Int_t ncpus,
+                                const RooArgSet *minosParams)
+{
+  Bool_t fitHesse=opt.Contains("h");
+  Bool_t fitSave=opt.Contains("r"); // return results
+  _status=0;
+  _nTries=0;
+  _timedOut=kFALSE;
+  _fromCache=kFALSE;
+
+  // floating params and their starting values
+  RooArgSet *params=pdf->getParameters(*data);
+  RooArgSet *floatParams=(RooArgSet*)params->selectByAttrib("Constant",kFALSE);
+
+  // report the fixed subtrees cached by constant-term optimization
+  if ((_constOpt>0)&&!opt.Contains("q")) {
+    RooArgList constPdfs;
+    Int_t nConstLeaves(0);
+    Int_t nLeaves=findConstSubtrees(pdf, data, constPdfs, nConstLeaves);
+    cout<<" Constant-term caching for "<<pdf->GetName()<<": "
+        <<nConstLeaves<<" of "<<nLeaves<<" leaf pdfs fixed"<<endl;
+    for (Int_t i=0; i<constPdfs.getSize(); i++)
+      cout<<"  cached subtree "<<constPdfs.at(i)->GetName()<<endl;
+  }
+  
+  // check the fit cache first
+  TString cacheKey("");
+  RooFitResult *fitResult(0);
+  if (""!=_cacheDir) {
+    cacheKey=getCacheKey(pdf, data, opt, condObs, minosParams);
+    fitResult=readCache(cacheKey);
+  }
+  if (fitResult) {
+    cout<<" Fit for "<<pdf->GetName()<<" on "<<data->GetName()
+        <<" restored from fit cache "<<cacheKey<<endl;
+    _fromCache=kTRUE;
+    _status=getFitStatus(fitResult, fitHesse);
+    setParams(*floatParams, fitResult->floatParsFinal());
+  } else if (isPlainFit()) {
+    // convert to newer fitTo format for steering options
+    Bool_t fitExtended=opt.Contains("e");
+    Bool_t fitMinos   =opt.Contains("m");
+    Bool_t fitVerbose =!opt.Contains("q");
+    if (minosParams&&(minosParams->getSize()>0))
+      fitResult=pdf->fitTo(*data, ConditionalObservables(condObs),
+                           Save(kTRUE), Extended(fitExtended),
+                           Verbose(fitVerbose), Hesse(fitHesse),
+                           Minos(*minosParams), NumCPU(ncpus),
+                           Optimize(_constOpt));
+    else
+      fitResult=pdf->fitTo(*data, ConditionalObservables(condObs),
+                           Save(kTRUE), Extended(fitExtended),
+                           Verbose(fitVerbose), Hesse(fitHesse),
+                           Minos(fitMinos), NumCPU(ncpus),
+                           Optimize(_constOpt));
+    _nTries=1;
+    _status=getFitStatus(fitResult, fitHesse);
+  } else {
+    RooArgSet *initParams=(RooArgSet*)floatParams->snapshot(kTRUE);
+    TStopwatch timer;
+    timer.Start();
+    Int_t strategy=_strategy<0 ? 1 : _strategy;
+    Int_t status(0);
+    for (Int_t iTry=0; iTry<=_nRetries; iTry++) {
+      Double_t timeLeft(0);
+      if (_maxTime>0) {
+        timeLeft=_maxTime-timer.RealTime();
+        timer.Continue();
+        if (timeLeft<=0) {
+          _timedOut=kTRUE;
+          break;
+        }
+      }
+      if (iTry>0) {
+        // restart from initial values
+        *floatParams=*initParams;
+        if (strategy<2) strategy++;
+        else if (_jitter>0) jitterParams(*floatParams, *initParams);
+        else break; // nothing left to change
+        cout<<" Retry #"<<iTry<<" of fit for "<<pdf->GetName()
+            <<" with strategy "<<strategy;
+        if (strategy>=2&&_jitter>0) cout<<" and jitter "<<_jitter;
+        cout<<endl;
+      }
+      _nTries++;
+      Bool_t expired(kFALSE);
+      RooFitResult *fr=minimize(pdf, data, opt, condObs, ncpus, minosParams,
+                                strategy, timeLeft, expired);
+      status=getFitStatus(fr, fitHesse);
+      if (expired) {
+        _timedOut=kTRUE;
+        status=-1;
+      }
+      // keep the best attempt
+      if ((!fitResult)||(0==status)||
+          ((0!=_status)&&(fr->minNll()<fitResult->minNll()))) {
+        delete fitResult;
+        fitResult=fr;
+        _status=status;
+      } else delete fr;
+      if ((0==status)||_timedOut) break;
+    }
+    // leave params at the best attempt
+    if (fitResult) setParams(*floatParams, fitResult->floatParsFinal());
+    if ((_nTries>1)||(0!=_status)) {
+      cout<<" Fit for "<<pdf->GetName()<<" on "<<data->GetName()
+          <<" has status "<<_status<<" after "<<_nTries<<" attempt(s)";
+      if (_timedOut) cout<<" (wall-time budget "<<_maxTime<<" s exceeded)";
+      cout<<endl;
+    }
+    delete initParams;
+  }
+  // save good fits in the cache
+  if ((""!=cacheKey)&&(!_fromCache)&&fitResult&&(0==_status))
+    writeCache(cacheKey, fitResult);
+
+  delete floatParams;
+  delete params;
+
+  if (!fitSave) {
+    delete fitResult;
+    fitResult=0;
+  }
+  return fitResult;
+}
+
+/// \brief Run one minimization
+///
+/// \param pdf The pdf to fit
+/// \param data The dataset to fit
+/// \param opt Fitting options
+/// \param condObs Conditional observables
+/// \param ncpus Number of CPUs (cores) to use in fit
+/// \param minosParams Params for minos
+/// \param strategy Minuit strategy
+/// \param maxTime Wall-time budget in seconds (<=0 means no limit)
+/// \param expired Set to true if the budget is exceeded
+/// \return The fit result object
+///
+/// It creates the NLL, wraps it with rarBudgetNLL,
+/// and minimizes it with RooMinimizer.
+/// Hesse and minos are skipped once the budget is exceeded.
+RooFitResult *rarFitDriver::minimize(RooAbsPdf *pdf, RooAbsData *data,
+                                     TString opt, const RooArgSet &condObs,
+                                     Int_t ncpus, const RooArgSet *minosParams,
+                                     Int_t strategy, Double_t maxTime,
+                                     Bool_t &expired)
+{
+  Bool_t fitExtended=opt.Contains("e");
+  Bool_t fitMinos   =opt.Contains("m");
+  Bool_t fitHesse   =opt.Contains("h");
+  Bool_t fitVerbose =!opt.Contains("q");
+
+  RooAbsReal *nll=pdf->createNLL(*data, ConditionalObservables(condObs),
+                                 Extended(fitExtended), NumCPU(ncpus));
+  rarBudgetNLL budgetNLL(Form("%s_budget", nll->GetName()), "budget NLL",
+                         *nll, maxTime);
+  RooFitResult *fr(0);
+  {
+    RooMinimizer m(budgetNLL);
+    m.setPrintLevel(1);
+    m.setVerbose(fitVerbose);
+    m.setStrategy(strategy);
+    m.optimizeConst(_constOpt);
+    if (_maxCalls>0) {
+      m.setMaxFunctionCalls(_maxCalls);
+      m.setMaxIterations(_maxCalls);
+    }
+    TString minType=_minType;
+    if (""==minType) minType="Minuit";
+    if (""==_minAlgo) m.minimize(minType);
+    else m.minimize(minType, _minAlgo);
+    if (!budgetNLL.isExpired()) {
+      if (fitHesse) m.hesse();
+      if (minosParams&&(minosParams->getSize()>0)) m.minos(*minosParams);
+      else if (fitMinos) m.minos();
+    }
+    fr=m.save();
+  }
+  expired=budgetNLL.isExpired();
+  delete nll;
+
+  return fr;
+}
+
+/// \brief Get the status of a fit result
+/// \param fr The fit result
+/// \param hesse If hesse is requested
+/// \return 0 if the fit is good, the status of the fit if not zero,
+///         or -2 if covQual is below #_minCovQual with hesse
+Int_t rarFitDriver::getFitStatus(RooFitResult *fr, Bool_t hesse) const
+{
+  if (!fr) return -1;
+  if (fr->status()) return fr->status();
+  if (hesse&&(fr->covQual()<_minCovQual)) return -2;
+  return 0;
+}
+
+/// \brief Find pdf subtrees with all params constant
+/// \param pdf The pdf to fit
+/// \param data The dataset to fit
+/// \param constPdfs Top nodes of the fixed subtrees
+/// \param nConstLeaves Number of fixed leaf pdfs
+/// \return Number of leaf pdfs
+///
+/// A pdf node is fixed if none of its real params floats;
+/// a leaf pdf has no other pdf below it.
+/// These are the nodes RooFit caches per event with constant-term
+/// optimization, and refreshes if any of their params is floated.
+Int_t rarFitDriver::findConstSubtrees(RooAbsPdf *pdf, RooAbsData *data,
+                                      RooArgList &constPdfs,
+                                      Int_t &nConstLeaves) const
+{
+  Int_t nLeaves(0);
+  nConstLeaves=0;
+  RooArgList nodes;
+  pdf->branchNodeServerList(&nodes);
+  RooArgSet constSet;
+  for (Int_t i=0; i<nodes.getSize(); i++) {
+    RooAbsPdf *thePdf=dynamic_cast<RooAbsPdf*>(nodes.at(i));
+    if (!thePdf) continue;
+    // is it fixed?
+    Bool_t isConst(kTRUE);
+    RooArgSet *params=thePdf->getParameters(*data);
+    RooArgList paramList(*params);
+    for (Int_t j=0; isConst&&(j<paramList.getSize()); j++) {
+      RooRealVar *theParam=dynamic_cast<RooRealVar*>(paramList.at(j));
+      if (theParam&&!theParam->isConstant()) isConst=kFALSE;
+    }
+    delete params;
+    if (isConst) constSet.add(*thePdf);
+    // is it a leaf?
+    RooArgList subNodes;
+    thePdf->branchNodeServerList(&subNodes);
+    Bool_t isLeaf(kTRUE);
+    for (Int_t j=0; isLeaf&&(j<subNodes.getSize()); j++)
+      if ((subNodes.at(j)!=thePdf)&&dynamic_cast<RooAbsPdf*>(subNodes.at(j)))
+        isLeaf=kFALSE;
+    if (!isLeaf) continue;
+    nLeaves++;
+    if (isConst) nConstLeaves++;
+  }
+  // only the top fixed nodes
+  RooArgList constList(constSet);
+  for (Int_t i=0; i<constList.getSize(); i++) {
+    RooAbsArg *theNode=constList.at(i);
+    Bool_t isTop(kTRUE);
+    TIterator *clientIter=theNode->clientIterator();
+    RooAbsArg *theClient(0);
+    while (isTop&&(theClient=(RooAbsArg*)clientIter->Next()))
+      if (constSet.find(theClient->GetName())==theClient) isTop=kFALSE;
+    delete clientIter;
+    if (isTop) constPdfs.add(*theNode);
+  }
+  
+  return nLeaves;
+}
+
+/// \brief Jitter floating params around their initial values
+/// \param params Params to jitter
+/// \param initParams Initial values of the params
+///
+/// Each param is shifted by a gaussian random number
+/// of width #_jitter times its initial error,
+/// or a tenth of its range (value) if it has no error.
+void rarFitDriver::jitterParams(RooArgSet &params, RooArgSet &initParams)
+{
+  TIterator* iter=params.createIterator();
+  RooAbsArg *theArg(0);
+  while(theArg=(RooAbsArg*)iter->Next()) {
+    RooRealVar *theParam=dynamic_cast<RooRealVar*>(theArg);
+    if (!theParam) continue;
+    RooRealVar *initParam=(RooRealVar*)initParams.find(theParam->GetName());
+    if (!initParam) continue;
+    Double_t sigma=initParam->getError();
+    if (sigma<=0) {
+      if (theParam->hasMin()&&theParam->hasMax())
+        sigma=(theParam->getMax()-theParam->getMin())/10.;
+      else sigma=TMath::Abs(initParam->getVal())/10.;
+    }
+    if (sigma<=0) continue;
+    theParam->setVal(initParam->getVal()+
+                     _jitter*sigma*RooRandom::randomGenerator()->Gaus());
+  }
+  delete iter;
+}
+
+/// \brief Set params from fit results
+/// \param params Params to set
+/// \param fitParams Final params of a fit result
+///
+/// It sets values and errors of \p params.
+void rarFitDriver::setParams(RooArgSet &params, const RooArgList &fitParams)
+{
+  for (Int_t i=0; i<fitParams.getSize(); i++) {
+    RooRealVar *fitParam=dynamic_cast<RooRealVar*>(fitParams.at(i));
+    if (!fitParam) continue;
+    RooRealVar *theParam=(RooRealVar*)params.find(fitParam->GetName());
+    if (!theParam) continue;
+    theParam->setVal(fitParam->getVal());
+    theParam->setError(fitParam->getError());
+    if (fitParam->hasAsymError())
+      theParam->setAsymError(fitParam->getAsymErrorLo(),
+                             fitParam->getAsymErrorHi());
+    else theParam->removeAsymError();
+  }
+}
+
+/// \brief Get the fit cache key
+///
+/// \param pdf The pdf to fit
+/// \param data The dataset to fit
+/// \param opt Fitting options
+/// \param condObs Conditional observables
+/// \param minosParams Params for minos
+/// \return MD5 hash (hex string) of the fit
+///
+/// The hash covers the model structure (class, name and servers
+/// of all nodes), the fit options and driver settings,
+/// the initial state (value, error, range, constness) of all params,
+/// and the contents of the dataset.
+TString rarFitDriver::getCacheKey(RooAbsPdf *pdf, RooAbsData *data,
+                                  TString opt, const RooArgSet &condObs,
+                                  const RooArgSet *minosParams) const
+{
+  stringstream keyStr;
+  keyStr<<setprecision(17);
+  // model structure
+  RooArgList nodes;
+  pdf->treeNodeServerList(&nodes);
+  for (Int_t i=0; i<nodes.getSize(); i++) {
+    nodes.at(i)->printStream(keyStr, RooPrintable::kClassName|
+                             RooPrintable::kName|RooPrintable::kArgs,
+                             RooPrintable::kSingleLine);
+  }
+  // fit options and settings
+  keyStr<<opt<<" "<<_minType<<" "<<_minAlgo<<" "<<_strategy<<" "
+        <<_nRetries<<" "<<_jitter<<" "<<_minCovQual<<" "<<_maxCalls<<endl;
+  RooArgList condObsList(condObs);
+  for (Int_t i=0; i<condObsList.getSize(); i++)
+    keyStr<<"condObs "<<condObsList.at(i)->GetName()<<endl;
+  if (minosParams) {
+    RooArgList minosList(*minosParams);
+    for (Int_t i=0; i<minosList.getSize(); i++)
+      keyStr<<"minos "<<minosList.at(i)->GetName()<<endl;
+  }
+  // initial param state
+  RooArgSet *params=pdf->getParameters(*data);
+  RooArgList paramList(*params);
+  for (Int_t i=0; i<paramList.getSize(); i++) {
+    RooAbsArg *theArg=paramList.at(i);
+    keyStr<<theArg->GetName();
+    RooRealVar *theParam=dynamic_cast<RooRealVar*>(theArg);
+    RooAbsCategory *theCat=dynamic_cast<RooAbsCategory*>(theArg);
+    if (theParam) {
+      keyStr<<" "<<theParam->getVal()<<" "<<theParam->getError()
+            <<" "<<theParam->getMin()<<" "<<theParam->getMax()
+            <<" "<<theParam->isConstant();
+    } else if (theCat) keyStr<<" "<<theCat->getIndex();
+    else if (dynamic_cast<RooAbsReal*>(theArg))
+      keyStr<<" "<<((RooAbsReal*)theArg)->getVal();
+    keyStr<<endl;
+  }
+  delete params;
+
+  TMD5 md5;
+  string theKeyStr=keyStr.str();
+  md5.Update((UChar_t*)theKeyStr.c_str(), theKeyStr.length());
+  // dataset contents
+  RooArgList dataVars(*data->get());
+  Int_t nVars=dataVars.getSize();
+  Int_t nEntries=data->numEntries();
+  md5.Update((UChar_t*)&nEntries, sizeof(nEntries));
+  for (Int_t i=0; i<nEntries; i++) {
+    data->get(i);
+    for (Int_t j=0; j<nVars; j++) {
+      RooAbsArg *theArg=dataVars.at(j);
+      RooAbsReal *theReal=dynamic_cast<RooAbsReal*>(theArg);
+      if (theReal) {
+        Double_t val=theReal->getVal();
+        md5.Update((UChar_t*)&val, sizeof(val));
+        continue;
+      }
+      RooAbsCategory *theCat=dynamic_cast<RooAbsCategory*>(theArg);
+      if (theCat) {
+        Int_t idx=theCat->getIndex();
+        md5.Update((UChar_t*)&idx, sizeof(idx));
+      }
+    }
+    Double_t wgt=data->weight();
+    md5.Update((UChar_t*)&wgt, sizeof(wgt));
+  }
+  md5.Final();
+
+  return md5.AsString();
+}
+
+/// \brief Read fit result from the fit cache
+/// \param cacheKey The cache key
+/// \return The fit result found (0 if not in the cache)
+RooFitResult *rarFitDriver::readCache(TString cacheKey) const
+{
+  TString cacheFile=_cacheDir+"/"+cacheKey+".root";
+  if (gSystem->AccessPathName(cacheFile)) return 0;
+  RooFitResult *fr(0);
+  TFile f(cacheFile);
+  RooFitResult *cachedFr=dynamic_cast<RooFitResult*>(f.Get("fitResult"));
+  if (cachedFr) fr=new RooFitResult(*cachedFr);
+  f.Close();
+  return fr;
+}
+
+/// \brief Write fit result to the fit cache
+/// \param cacheKey The cache key
+/// \param fr The fit result
+void rarFitDriver::writeCache(TString cacheKey, RooFitResult *fr) const
+{
+  if (gSystem->AccessPathName(_cacheDir)&&gSystem->mkdir(_cacheDir, kTRUE)) {
+    cout<<" Can not create fit cache dir "<<_cacheDir<<endl;
+    return;
+  }
+  TString cacheFile=_cacheDir+"/"+cacheKey+".root";
+  TFile f(cacheFile, "recreate");
+  fr->Write("fitResult");
+  f.Close();
+}
@@ -104,4 +104,8 @@ void rarFlatte::init()
   // create pdf
   _thePdf=new RooFlatte(Form("the_%s", GetName()),_pdfType+" "+GetTitle(),
 			*_x, *_mean, *_g0, *_m0a, *_m0b, *_g1, *_m1a, *_m1b);
+  // interpolated normalization if configured
+  _thePdf=cacheNorm(_thePdf, _x, "mean g0 m0a m0b g1 m1a m1b",
+                    RooArgList(*_mean, *_g0, *_m0a, *_m0b,
+                               *_g1, *_m1a, *_m1b));
 }
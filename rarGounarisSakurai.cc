@@ -101,4 +101,8 @@ void rarGounarisSakurai::init()
   _thePdf=new RooGounarisSakurai(Form("the_%s", GetName()),_pdfType+" "+GetTitle(),
 				 *_x, *_mean, *_width, *_spin, 
 				 *_radius, *_mass_a, *_mass_b);
+  // interpolated normalization if configured
+  _thePdf=cacheNorm(_thePdf, _x, "mean width spin radius mass_a mass_b",
+                    RooArgList(*_mean, *_width, *_spin,
+                               *_radius, *_mass_a, *_mass_b));
 }
@@ -29,6 +29,7 @@
 #include "RooStringVar.h"
 
 #include "RooHistPdf.h"
+#include "RooRarSparseHistPdf.hh"
 #include "rarHistPdf.hh"
 
 ClassImp(rarHistPdf)
@@ -76,7 +77,8 @@ rarHistPdf::~rarHistPdf()
 /// \p init is called by the ctor.
 /// It first reads in observable info from config item \p obs,
 /// and use #getFormulaArgs to get ArgList of the PDF,
-/// and finally it builds RooHistPdf.
+/// and finally it builds RooHistPdf,
+/// or RooRarSparseHistPdf if config item \p sparse is \p yes.
 void rarHistPdf::init()
 {
   cout<<"init of rarHistPdf for "<<GetName()<<":"<<endl;
@@ -97,6 +99,14 @@ void rarHistPdf::init()
     cout<<" No dataset for HistPdf"<<endl;
     exit(-1);
   }
+  // sparse histogram?
+  if ("yes"==readConfStr("sparse", "no", getVarSec())) {
+    Int_t intOrder=atoi(readConfStr("intOrder", "0", getVarSec()));
+    _thePdf=new RooRarSparseHistPdf(Form("the_%s", GetName()),
+                                    _pdfType+" "+GetTitle(),
+                                    RooArgList(_obsSet), *_theData, intOrder);
+    return;
+  }
   // create the RooDataHist
   _theHist=new RooDataHist(Form("the_%s_Hist", GetName()),
 			   "pdf histogram", _obsSet, *_theData);
@@ -21,8 +21,12 @@
 
 #include "Riostream.h"
 
+#include "TH1.h"
+
 #include "RooArgList.h"
+#include "RooDataHist.h"
 #include "RooDataSet.h"
+#include "RooHistPdf.h"
 #include "RooProdPdf.h"
 #include "RooRealVar.h"
 #include "RooStringVar.h"
@@ -30,6 +34,7 @@
 #include "Roo2DKeysPdf.h"
 #include "RooKeysPdf.h"
 
+#include "rarFFTKeys.hh"
 #include "rarKeys.hh"
 
 ClassImp(rarKeys)
@@ -40,7 +45,8 @@ ClassImp(rarKeys)
 /// Usually the objects should be created using other ctors.
 rarKeys::rarKeys()
   : rarBasePdf(),
-    _x(0), _y(0), _rho(1.), _keysOption("")
+    _x(0), _y(0), _rho(1.), _keysOption(""),
+    _keysMethod("exact"), _keysBins(0), _keysCacheDir(""), _keysHist(0)
 {
   init();
 }
@@ -63,7 +69,8 @@ rarKeys::rarKeys(const char *configFile, const char *configSec,
 		 const char *name, const char *title)
   : rarBasePdf(configFile, configSec, configStr,
 	       theDatasets, theData, name, title),
-    _x(0), _y(0), _rho(1.), _keysOption("")
+    _x(0), _y(0), _rho(1.), _keysOption(""),
+    _keysMethod("exact"), _keysBins(0), _keysCacheDir(""), _keysHist(0)
 {
   init();
 }
@@ -80,7 +87,8 @@ rarKeys::~rarKeys()
 /// so the first step is to set #_pdfFit to false.
 /// It reads in #_rho and #_keysOption,
 /// and finally it builds RooKeysPdf/Roo2DKeysPdf PDF
-/// with #_pdfType being Keys/2DKeys, respectively.
+/// with #_pdfType being Keys/2DKeys, respectively,
+/// or RooHistPdf of the binned Keys shape if #_keysMethod is fft.
 void rarKeys::init()
 {
   cout<<"init of rarKeys for "<<GetName()<<":"<<endl;
@@ -101,6 +109,39 @@ void rarKeys::init()
   // read in options
   _rho=atof(readConfStr("rho", "1.", getVarSec()));
   _keysOption=readConfStr("keysOption", "", getVarSec());
+  _keysMethod=readConfStr("keysMethod", "exact", getVarSec());
+  
+  // create binned Keys pdf
+  if ("fft"==_keysMethod) {
+    _keysBins=atoi(readConfStr("keysBins", "2DKeys"==_pdfType?"128":"1000",
+                               getVarSec()));
+    if ("no"!=readConfStr("keysCache", "yes", getVarSec())) {
+      _keysCacheDir=readConfStr("keysCacheDir",
+                                getDefResultDir()+"/keysCache", getVarSec());
+    }
+    RooArgList pdfObs(*_x);
+    if (_y) pdfObs.add(*_y);
+    RooArgList gridObs;
+    for (Int_t i=0; i<pdfObs.getSize(); i++) {
+      RooRealVar *theObs=dynamic_cast<RooRealVar*>(pdfObs.at(i));
+      if (!theObs) {
+        cout<<" Observable "<<pdfObs.at(i)->GetName()<<" of "<<GetName()
+            <<" must be RooRealVar for keysMethod = fft"<<endl;
+        exit(-1);
+      }
+      RooRealVar *gridVar=
+        new RooRealVar(Form("%s_%s_keysGrid", theObs->GetName(), GetName()),
+                       theObs->GetTitle(), theObs->getMin(), theObs->getMax());
+      gridVar->setBins(_keysBins);
+      gridObs.add(*gridVar);
+    }
+    _keysHist=new RooDataHist(Form("the_%s_keysHist", GetName()),
+                              "binned Keys shape", RooArgSet(gridObs));
+    fillKeysHist();
+    _thePdf=new RooHistPdf(Form("the_%s", GetName()),_pdfType+" "+GetTitle(),
+                           pdfObs, gridObs, *_keysHist, 1);
+    return;
+  }
   
   // create pdf
   if ("2DKeys"==_pdfType) {
@@ -133,15 +174,46 @@ void rarKeys::init()
 /// Load \p theData as Keys dataset for pdf modeling.
 /// There is no need to do pdfFit,
 /// instead, 1/2D Keys PDFs call their LoadDataSet/loadDataSet functions
-/// to load initial values (datasets).
+/// to load initial values (datasets),
+/// or the binned Keys shape is rebuilt by #fillKeysHist.
 void rarKeys::setFitData(RooDataSet *theData)
 {
   RooDataSet *oldData=_theData;
   // set dataset
   rarBasePdf::setFitData(theData);
   if (_theData==oldData) return;
+  // recalculate binned keys shape
+  if (_keysHist) {
+    fillKeysHist();
+    _thePdf->setValueDirty();
+    return;
+  }
   // recalculate keys pdf
   if ("Keys"==_pdfType) ((RooKeysPdf*)_thePdf)->LoadDataSet(*_theData);
   if ("2DKeys"==_pdfType)
     ((Roo2DKeysPdf*)_thePdf)->loadDataSet(*_theData, _keysOption);
 }
+
+/// \brief Fill binned Keys shape
+///
+/// It builds the Keys table of #_theData with rarFFTKeys
+/// (or restores it from the cache),
+/// and copies it into #_keysHist.
+void rarKeys::fillKeysHist()
+{
+  RooArgList gridObs(*_keysHist->get());
+  RooRealVar *gx=(RooRealVar*)gridObs.at(0);
+  RooRealVar *gy=_y?(RooRealVar*)gridObs.at(1):0;
+  rarFFTKeys keysBuilder(_keysBins, _rho, _keysOption, _keysCacheDir);
+  TH1 *table=keysBuilder.build(*_theData, _x->GetName(),
+                               gx->getMin(), gx->getMax(),
+                               _y?_y->GetName():0,
+                               gy?gy->getMin():0, gy?gy->getMax():0);
+  for (Int_t i=0; i<_keysHist->numEntries(); i++) {
+    const RooArgSet *row=_keysHist->get(i);
+    Int_t bin=gy?table->FindBin(gx->getVal(), gy->getVal()):
+      table->FindBin(gx->getVal());
+    _keysHist->set(*row, table->GetBinContent(bin));
+  }
+  delete table;
+}
@@ -99,5 +99,9 @@ void rarLass::init()
 
   _thePdf = new RooLass(Form("the_%s", GetName()),_pdfType+" "+GetTitle(),
 			       *_x, *_mean, *_width, *_effRange, *_scatlen, *_turnOffVal);
+  // interpolated normalization if configured
+  _thePdf=cacheNorm(_thePdf, _x, "mean width effRange scatlen turnOffVal",
+                    RooArgList(*_mean, *_width, *_effRange,
+                               *_scatlen, *_turnOffVal));
 
 }
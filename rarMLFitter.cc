@@ -20,6 +20,7 @@
 #include "rarVersion.hh"
 
 #include "Riostream.h"
+#include <iomanip>
 #include <sstream>
 #include <map>
 #include <set>
@@ -29,22 +30,32 @@ using namespace std;
 #include <libgen.h>
 #include "TFile.h"
 #include "TTree.h"
+#include "TArrayI.h"
+#include "TDirectory.h"
+#include "TMD5.h"
 #include "TObjString.h"
 #include "TStopwatch.h"
+#include "TSystem.h"
 
 #include "Roo1DTable.h"
 #include "RooAbsPdf.h"
+#include "RooAbsProxy.h"
 #include "RooAddPdf.h"
+#include "RooArgProxy.h"
 #include "RooChi2Var.h"
 #include "RooHistError.h"
 #include "RooArgList.h"
 #include "RooDataSet.h"
+#include "RooExpensiveObjectCache.h"
 #include "RooFitResult.h"
 #include "RooMCStudy.h"
+#include "RooMinimizer.h"
 #include "RooNLLVar.h"
 #include "RooPlot.h"
 #include "RooProdPdf.h"
+#include "RooNumIntConfig.h"
 #include "RooRandom.h"
+#include "RooRealIntegral.h"
 #include "RooRealVar.h"
 #include "RooSimPdfBuilder.h"
 #include "RooStringVar.h"
@@ -54,6 +65,7 @@ using namespace std;
 
 using namespace RooFit;
 
+#include "rarFitDriver.hh"
 #include "rarMinuit.hh"
 #include "rarMLPdf.hh"
 #include "rarNLL.hh"
@@ -77,7 +89,7 @@ rarMLFitter::rarMLFitter()
   : rarCompBase(),
     _simBuilder(0), _simConfig(0), _theGen(0), _protGenLevel(0),
     _protDataset(0), _theToyParamGen(0), _theSPdf(0), _theBPdf(0),
-    _toyID(0), _toyNexp(0)
+    _toyID(0), _toyNexp(0), _normIntCacheFile("")
 {
   init();
 }
@@ -101,7 +113,7 @@ rarMLFitter::rarMLFitter(const char *configFile, const char *configSec,
 		theDatasets, theData, name, title, kFALSE),
     _simBuilder(0), _simConfig(0), _theGen(0), _protGenLevel(0),
     _protDataset(0), _theToyParamGen(0), _theSPdf(0), _theBPdf(0),
-    _toyID(0), _toyNexp(0)
+    _toyID(0), _toyNexp(0), _normIntCacheFile("")
 {
   init();
 }
@@ -115,6 +127,8 @@ rarMLFitter::~rarMLFitter()
 /// \p init is called by the ctor.
 /// It cheks to see if it is needed to build SimPdf for the final ml model.
 /// If yes, it will build the SimPdf using RooSimPdfBuilder.
+/// With config \p dedupPdfNodes = \p yes,
+/// identical shapes of the final model are merged by #dedupPdfNodes.
 void rarMLFitter::init()
 {
   //if (!getFitter()) setFitter(this);
@@ -164,6 +178,9 @@ void rarMLFitter::init()
     //_thePdf->Print("v");
     setSimPdf((RooSimultaneous*)_thePdf);
   }
+  // merge structurally identical shapes of the final model
+  if ("yes"==readConfStr("dedupPdfNodes", "no", getVarSec()))
+    dedupPdfNodes(_thePdf);
   { // create extra pdfs as toy param randomizer
     Int_t xPdfs=_xPdfList.GetSize();
     createPdfs("preToyRandGenerators",&_xPdfList,&_preToyRandGenerators,
@@ -269,6 +286,96 @@ void rarMLFitter::setSpecialStr(RooArgSet *simConfigSet)
   }
 }
 
+/// \brief Merge structurally identical shapes of a model
+/// \param topPdf The model
+/// \return Number of nodes merged
+///
+/// Shapes created from different config sections,
+/// or cloned per category when building the SimPdf,
+/// are separate nodes even if they have the same class, the same servers
+/// and the same meta args (eg, formula).
+/// Such nodes are evaluated separately for each event.
+/// Each of them is replaced by the first one found in all its clients
+/// in the model, so the shape is evaluated once.
+/// Only classes whose state is fully given by their servers
+/// and meta args (as printed, eg, the precision of RooRarVoigtian)
+/// are merged,
+/// and not when a client already has both nodes as servers.
+/// The merged nodes can not be plotted as components by their names.
+Int_t rarMLFitter::dedupPdfNodes(RooAbsPdf *topPdf)
+{
+  static const char *dedupClasses[]={
+    "RooArgusBG", "RooBifurGauss", "RooBreitWigner", "RooCBShape",
+    "RooChebychev", "RooExponential", "RooGaussian", "RooGenericPdf",
+    "RooLandau", "RooNovosibirsk", "RooRarVoigtian", "RooBallack",
+    "RooCruijff", 0};
+  cout<<endl<<" In rarMLFitter dedupPdfNodes for "<<topPdf->GetName()<<endl;
+  Int_t nMerged(0);
+  Bool_t changed(kTRUE);
+  while (changed) {
+    changed=kFALSE;
+    RooArgList nodes;
+    topPdf->branchNodeServerList(&nodes);
+    map<string, RooAbsArg*> canonNodes;
+    for (Int_t i=0; !changed&&(i<nodes.getSize()); i++) {
+      RooAbsArg *theNode=nodes.at(i);
+      if (theNode==topPdf) continue;
+      Bool_t canMerge(kFALSE);
+      for (Int_t j=0; !canMerge&&dedupClasses[j]; j++)
+        if (!strcmp(theNode->ClassName(), dedupClasses[j])) canMerge=kTRUE;
+      if (!canMerge) continue;
+      // structural key: class, server of each proxy, args
+      stringstream keyStr;
+      keyStr<<theNode->ClassName();
+      for (Int_t j=0; j<theNode->numProxies(); j++) {
+        RooAbsProxy *theProxy=theNode->getProxy(j);
+        if (!theProxy) continue;
+        keyStr<<" "<<theProxy->name()<<"=";
+        RooArgProxy *argProxy=dynamic_cast<RooArgProxy*>(theProxy);
+        RooAbsCollection *listProxy=dynamic_cast<RooAbsCollection*>(theProxy);
+        if (argProxy) keyStr<<argProxy->absArg();
+        else if (listProxy) {
+          RooArgList proxyList(*listProxy);
+          for (Int_t k=0; k<proxyList.getSize(); k++)
+            keyStr<<(k?",":"")<<proxyList.at(k);
+        }
+      }
+      theNode->printStream(keyStr, RooPrintable::kArgs,
+                           RooPrintable::kSingleLine);
+      RooAbsArg *&canonNode=canonNodes[keyStr.str()];
+      if (!canonNode) {
+        canonNode=theNode;
+        continue;
+      }
+      // clients in the model
+      RooArgList clients;
+      Bool_t hasBoth(kFALSE);
+      TIterator *clientIter=theNode->clientIterator();
+      RooAbsArg *theClient(0);
+      while ((theClient=(RooAbsArg*)clientIter->Next())) {
+        if (nodes.find(theClient->GetName())!=theClient) continue;
+        if (theClient->findServer(*canonNode)) hasBoth=kTRUE;
+        clients.add(*theClient, kTRUE);
+      }
+      delete clientIter;
+      if (hasBoth||(clients.getSize()<1)) continue;
+      // redirect them to the first node
+      TString origName=Form("ORIGNAME:%s", theNode->GetName());
+      canonNode->setAttribute(origName);
+      for (Int_t j=0; j<clients.getSize(); j++)
+        clients.at(j)->redirectServers(RooArgSet(*canonNode), kFALSE, kTRUE);
+      canonNode->setAttribute(origName, kFALSE);
+      cout<<" "<<theNode->GetName()<<" merged into "
+          <<canonNode->GetName()<<endl;
+      nMerged++;
+      changed=kTRUE;
+    }
+  }
+  cout<<" "<<nMerged<<" identical node(s) merged"<<endl;
+  
+  return nMerged;
+}
+
 /// \brief Return the special ArgSet for splitting
 /// \param setName The name of the ArgSet
 /// \return The special ArgSet for splitting
@@ -654,19 +761,9 @@ RooFitResult *rarMLFitter::doMLFit(RooDataSet *mlFitData,
   // first check if it has its pdf
   assert(_thePdf);
   
-  // convert to newer fitTo format for steering options
-  Bool_t mlFitExtended = opt.Contains("e");
-  Bool_t mlFitMinos    = opt.Contains("m");
-  Bool_t mlFitHesse    = opt.Contains("h");
-  Bool_t mlFitVerbose  = !opt.Contains("q");
-  Bool_t mlFitSave     = opt.Contains("r"); // return results
-
   //_thePdf->Print();
   //fit to its dataset
-  fitResult=_thePdf->fitTo(*mlFitData, ConditionalObservables(_conditionalObs),
-  			   Save(mlFitSave), Extended(mlFitExtended), 
-			   Verbose(mlFitVerbose), Hesse(mlFitHesse),
-			   Minos(mlFitMinos), NumCPU(ncpus));
+  fitResult=doTheFit(_thePdf, mlFitData, opt, ncpus);
 
   // needed to fill "GblCorr." column of printout (now redundant?) FFW
   fitResult->globalCorr();
@@ -695,7 +792,8 @@ RooFitResult *rarMLFitter::doMLFit(RooDataSet *mlFitData,
 /// \param ncpus Number of CPUs (cores) to use in fit (default=1)
 /// \return The fit result object
 ///
-/// It is a wrapper for calls to fiTo() method.
+/// It is a wrapper for calls to rarFitDriver::fit,
+/// configured by #setupFitDriver.
 RooFitResult *rarMLFitter::doTheFit(RooAbsPdf *pdf, RooDataSet *fitData, TString fitOptions, Int_t ncpus)
 {
   cout<<endl<<"In rarMLFitter doTheFit for "<<GetName()<< " Options: " << fitOptions 
@@ -704,23 +802,23 @@ RooFitResult *rarMLFitter::doTheFit(RooAbsPdf *pdf, RooDataSet *fitData, TString
   // first check if it has its pdf
   assert(pdf);
   
-  // convert to newer fitTo format for steering options
-  Bool_t fitExtended = fitOptions.Contains("e");
-  Bool_t fitMinos    = fitOptions.Contains("m");
-  Bool_t fitHesse    = fitOptions.Contains("h");
-  Bool_t fitVerbose  = !fitOptions.Contains("q");
-  Bool_t fitSave     = fitOptions.Contains("r"); // return results
+  rarFitDriver fitDriver;
+  setupFitDriver(fitDriver);
 
   TStopwatch timer;
   timer.Start();
   // fit to its dataset
-  RooFitResult *fitResult=_thePdf->fitTo(*fitData, ConditionalObservables(_conditionalObs),
-					 Save(fitSave), Extended(fitExtended), 
-					 Verbose(fitVerbose), Hesse(fitHesse),
-					 Minos(fitMinos), NumCPU(ncpus));
+  RooFitResult *fitResult=
+    fitDriver.fit(pdf, fitData, fitOptions, _conditionalObs, ncpus);
   timer.Stop();
   // output the time
   cout<<endl<<"The doTheFit RealTime= " << timer.RealTime() << " CpuTime= "<< timer.CpuTime() << endl;
+  if (fitDriver.getStatus()) {
+    cout<<" W A R N I N G ! ! !"<<endl
+        <<" Fit of "<<pdf->GetName()<<" failed with status "
+        <<fitDriver.getStatus()<<" after "<<fitDriver.getNTries()
+        <<" attempt(s)"<<endl;
+  }
   
   return fitResult;
 }
@@ -744,12 +842,6 @@ void rarMLFitter::doSignf(RooDataSet *mlFitData, TString signfStr,
   writeToStr(fullParams, fParamSStr0);
   
   TString signfFitOpt="qemhr";
-  // convert to newer fitTo format for steering options
-  Bool_t signfFitExtended = signfFitOpt.Contains("e");
-  Bool_t signfFitMinos    = signfFitOpt.Contains("m");
-  Bool_t signfFitHesse    = signfFitOpt.Contains("h");
-  Bool_t signfFitVerbose  = !signfFitOpt.Contains("q");
-  Bool_t signfFitSave     = signfFitOpt.Contains("r"); // return results
 
   // get nll
   if (!fitResult) {
@@ -777,18 +869,12 @@ void rarMLFitter::doSignf(RooDataSet *mlFitData, TString signfStr,
     theParam->setConstant();
 
     // fit again
-    //Int_t ncpus(1);
-
-    RooFitResult *theResult=
-      _thePdf->fitTo(*mlFitData, ConditionalObservables(_conditionalObs), 
-    		     Save(signfFitSave), Extended(signfFitExtended), 
-    		     Verbose(signfFitVerbose), Hesse(signfFitHesse),
-		     Minos(signfFitMinos));
-    //RooFitResult *theResult = doTheFit(_thePdf, mlFitData, signfFitOpt, ncpus);
+    RooFitResult *theResult=doTheFit(_thePdf, mlFitData, signfFitOpt);
 
     o<<" Signf. of "<<theParam->GetName()<<" being "<<sVal
      <<" wrt "<<zSignfVal<<" is "<<sqrt(2*theResult->minNll()-nll)
      <<" (sigma)"<<endl;
+    delete theResult;
   }
   
   // restore saved params
@@ -804,6 +890,11 @@ void rarMLFitter::doSignf(RooDataSet *mlFitData, TString signfStr,
 /// \param o The output stream
 ///
 /// It performs systematic error study.
+/// The config \p postMLSysMode in action section chooses the method:
+/// \p refit (default) refits for plus and minus variation of each param,
+/// \p linear propagates the variations through the covariance matrix
+/// from one Hesse evaluation with the varied params floated
+/// (see #getSysSensitivity), and \p both outputs the two tables.
 void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
 			     TString varsStr, RooArgSet fullParams,
 			     ostream &o)
@@ -837,23 +928,14 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
   }
   cout<<" postMLSysVars:"<<endl;
   studyVars.Print("v");
+  // refit and/or linear propagation
+  TString sysMode=readConfStrCnA("postMLSysMode", "refit");
+  Bool_t doRefit=("linear"!=sysMode);
+  Bool_t doLinear=("linear"==sysMode)||("both"==sysMode);
+  cout<<" postMLSysMode: "<<sysMode<<endl;
   // fit again with option emhr
   TString sysFitOpt="qemhr";
-
-  //Int_t ncpus(1);
-
-  // convert to newer fitTo format for steering options
-  Bool_t sysFitExtended = sysFitOpt.Contains("e");
-  Bool_t sysFitMinos    = sysFitOpt.Contains("m");
-  Bool_t sysFitHesse    = sysFitOpt.Contains("h");
-  Bool_t sysFitVerbose  = !sysFitOpt.Contains("q");
-  Bool_t sysFitSave     = sysFitOpt.Contains("r"); // return results
-
-  _thePdf->fitTo(*mlFitData, ConditionalObservables(_conditionalObs), 
-		 Save(sysFitSave), Extended(sysFitExtended), 
-		 Verbose(sysFitVerbose), Hesse(sysFitHesse),
-		 Minos(sysFitMinos));
-  //  doTheFit(_thePdf, mlFitData, sysFitOpt, ncpus);
+  delete doTheFit(_thePdf, mlFitData, sysFitOpt);
 
   string fParamSStr;
   writeToStr(fullParams, fParamSStr);
@@ -869,12 +951,41 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
       paramsStrParser.Remove();
     }
   }
+  // sensitivity of study vars to all params varied
+  RooArgList sysParamList;
+  TMatrixD sensM;
+  if (doLinear) {
+    rarStrParser sysParamsParser=paramsStrParser;
+    while (sysParamsParser.nArgs()>0) {
+      TString theParamName=sysParamsParser[0];
+      sysParamsParser.Remove();
+      if (isNumber(theParamName)) continue;
+      TIterator* iter = fullParams.createIterator();
+      RooRealVar *theParam(0);
+      while(theParam=(RooRealVar*)iter->Next()) {
+        TString theName=theParam->GetName();
+        if ((theName==theParamName)||(theName.BeginsWith(theParamName+"_")))
+          if (!sysParamList.find(theName)) sysParamList.add(*theParam);
+      }
+      delete iter;
+    }
+    sensM.ResizeTo(studyVars.getSize(), sysParamList.getSize());
+    if (!getSysSensitivity(mlFitData, RooArgList(studyVars), sysParamList,
+                           sensM)) {
+      cout<<" W A R N I N G ! ! !"<<endl
+          <<" Can not get linearized systematic errors"<<endl;
+      doLinear=kFALSE;
+      doRefit=kTRUE;
+    }
+    // restore params (values and errors) from nominal fit
+    readFromStr(fullParams, fParamSStr);
+  }
   Int_t nSysParams(0);
   // string for all params varied
   TString vParams="";
   TArrayD pV(1), mV(1);
   TArrayD pArray(studyVars.getSize()), mArray(studyVars.getSize());
-  TArrayD aArray(studyVars.getSize()); // avg error
+  TArrayD lpArray(studyVars.getSize()), lmArray(studyVars.getSize());
   // loop over all params
   while (paramsStrParser.nArgs()>0) {
     TString theParamName=paramsStrParser[0];
@@ -901,7 +1012,8 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
     mV.Set(nSysParams);
     pArray.Set(nSysParams*studyVars.getSize());
     mArray.Set(nSysParams*studyVars.getSize());
-    aArray.Set(nSysParams*studyVars.getSize());
+    lpArray.Set(nSysParams*studyVars.getSize());
+    lmArray.Set(nSysParams*studyVars.getSize());
     // for this param
     cout<<" SysStudy for "<<theParamName<<endl;
     theParamSet.Print("v");
@@ -917,20 +1029,19 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
 	if (myVStr.EndsWith("V")||(myVStr.EndsWith("v"))) useErr=kFALSE;
       }
     }
-    // restore params
-    readFromStr(fullParams, fParamSStr);
-    // set variation
-    setVariation(theParamSet, pV[nSysParams-1], useErr, kTRUE);
-    // fit
-
-    _thePdf->fitTo(*mlFitData, ConditionalObservables(_conditionalObs), 
-   		   Save(sysFitSave), Extended(sysFitExtended), 
-		   Verbose(sysFitVerbose), Hesse(sysFitHesse),
-		   Minos(sysFitMinos));
-   // doTheFit(_thePdf, mlFitData, sysFitOpt, ncpus);
-
-    // calculation errors
-    calSysErrors(nSysParams-1, *cStudyVars, studyVars, pArray);
+    if (doLinear)
+      calLinSysErrors(nSysParams-1, sensM, sysParamList, theParamSet,
+                      pV[nSysParams-1], useErr, kTRUE, lpArray);
+    if (doRefit) {
+      // restore params
+      readFromStr(fullParams, fParamSStr);
+      // set variation
+      setVariation(theParamSet, pV[nSysParams-1], useErr, kTRUE);
+      // fit
+      delete doTheFit(_thePdf, mlFitData, sysFitOpt);
+      // calculation errors
+      calSysErrors(nSysParams-1, *cStudyVars, studyVars, pArray);
+    }
     // for minus variation
     // do we have minusV specified?
     mV[nSysParams-1]=pV[nSysParams-1];
@@ -942,27 +1053,180 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
 	if (myVStr.EndsWith("V")||(myVStr.EndsWith("v"))) useErr=kFALSE;
       }
     }
-    // restore params
-    readFromStr(fullParams, fParamSStr);
-    // set variation
-    setVariation(theParamSet, mV[nSysParams-1], useErr, kFALSE);
-    // fit
-    _thePdf->fitTo(*mlFitData, ConditionalObservables(_conditionalObs), 
-    		   Save(sysFitSave), Extended(sysFitExtended), 
-		   Verbose(sysFitVerbose), Hesse(sysFitHesse),
-		   Minos(sysFitMinos));
-    //doTheFit(_thePdf, mlFitData, sysFitOpt, ncpus);
-    // calculation errors
-    calSysErrors(nSysParams-1, *cStudyVars, studyVars, mArray);
+    if (doLinear)
+      calLinSysErrors(nSysParams-1, sensM, sysParamList, theParamSet,
+                      mV[nSysParams-1], useErr, kFALSE, lmArray);
+    if (doRefit) {
+      // restore params
+      readFromStr(fullParams, fParamSStr);
+      // set variation
+      setVariation(theParamSet, mV[nSysParams-1], useErr, kFALSE);
+      // fit
+      delete doTheFit(_thePdf, mlFitData, sysFitOpt);
+      // calculation errors
+      calSysErrors(nSysParams-1, *cStudyVars, studyVars, mArray);
+    }
   }
   // get correlation matrix
   TMatrixD corrM1=getCorrMatrix(nSysParams, vParams, kTRUE);
   TMatrixD corrM=getCorrMatrix(nSysParams, vParams);
-  // output error table
-  o<<endl<<" Systematic Error Table:"<<endl;
+  // output error tables
+  RooArgList studyVarList(studyVars);
+  if (doRefit)
+    outSysTable(o, " Systematic Error Table:", studyVarList, vParams,
+                paramNameLen, pV, pArray, mV, mArray, corrM1, corrM);
+  if (doLinear)
+    outSysTable(o, " Linearized Systematic Error Table:", studyVarList,
+                vParams, paramNameLen, pV, lpArray, mV, lmArray, corrM1, corrM);
+  delete cStudyVars;
+  // restore saved params
+  readFromStr(fullParams, fParamSStr0);
+  return;
+}
+
+/// \brief Sensitivity of study vars to varied params
+/// \param mlFitData Dataset to fit for mlFit action
+/// \param studyVarList Vars to study
+/// \param sysParamList Params to vary
+/// \param sensM Matrix of d(study var)/d(varied param)
+/// \return true if successful
+///
+/// At the current minimum, it floats the params to vary,
+/// runs Hesse once for the NLL with all floating params,
+/// and gets the linear response of the study vars
+/// to shifts of the varied params from the covariance matrix V,
+/// \verbatim
+/// sensM = V(study, varied) * V(varied, varied)^-1\endverbatim
+/// which is the same as -H(float, float)^-1 * H(float, varied)
+/// of the Hessian matrix H.
+/// It fails unless the covariance matrix is accurate (covQual 3),
+/// and the caller then falls back to refits.
+/// The params are not restored here.
+Bool_t rarMLFitter::getSysSensitivity(RooDataSet *mlFitData,
+                                      RooArgList studyVarList,
+                                      RooArgList sysParamList,
+                                      TMatrixD &sensM)
+{
+  Int_t nStudyVars=studyVarList.getSize();
+  Int_t nSysParams=sysParamList.getSize();
+  if (nSysParams<1) return kFALSE;
+  // float varied params (they have been fixed in the fit)
+  RooArgSet fixedSysParams;
+  for (Int_t i=0; i<nSysParams; i++) {
+    RooRealVar *theParam=(RooRealVar*)sysParamList.at(i);
+    if (theParam->isConstant()) fixedSysParams.add(*theParam);
+    else cout<<" W A R N I N G !"<<endl
+             <<" "<<theParam->GetName()<<" is floating in the fit,"
+             <<" its linearized variation is meaningless"<<endl;
+  }
+  fixedSysParams.setAttribAll("Constant", kFALSE);
+  // one Hesse with varied params floating
+  Int_t ncpus=atoi(readConfStr("useNumCPU", "1", getMasterSec()));
+  RooAbsReal *nll=_thePdf->createNLL(*mlFitData, Extended(kTRUE),
+                                     ConditionalObservables(_conditionalObs),
+                                     NumCPU(ncpus));
+  RooFitResult *fr(0);
+  {
+    RooMinimizer m(*nll);
+    m.setPrintLevel(-1);
+    m.optimizeConst(kTRUE);
+    m.hesse();
+    fr=m.save();
+  }
+  delete nll;
+  fixedSysParams.setAttribAll("Constant");
+  // find indices in covariance matrix
+  const RooArgList &floatPars=fr->floatParsFinal();
+  TArrayI studyIdx(nStudyVars), sysIdx(nSysParams);
+  for (Int_t i=0; i<nStudyVars; i++)
+    studyIdx[i]=floatPars.index(studyVarList.at(i)->GetName());
+  for (Int_t i=0; i<nSysParams; i++)
+    sysIdx[i]=floatPars.index(sysParamList.at(i)->GetName());
+  Bool_t retVal=(3==fr->covQual());
+  for (Int_t i=0; i<nStudyVars; i++) if (studyIdx[i]<0) retVal=kFALSE;
+  for (Int_t i=0; i<nSysParams; i++) if (sysIdx[i]<0) retVal=kFALSE;
+  if (!retVal) {
+    cout<<" Hesse with varied params floating failed or not accurate"
+        <<" (covQual "<<fr->covQual()<<")"<<endl;
+    delete fr;
+    return retVal;
+  }
+  // sensM = V(study, varied) * V(varied, varied)^-1
+  const TMatrixDSym &covM=fr->covarianceMatrix();
+  TMatrixD vSP(nStudyVars, nSysParams), vPP(nSysParams, nSysParams);
+  for (Int_t j=0; j<nSysParams; j++) {
+    for (Int_t i=0; i<nStudyVars; i++) vSP(i,j)=covM(studyIdx[i], sysIdx[j]);
+    for (Int_t i=0; i<nSysParams; i++) vPP(i,j)=covM(sysIdx[i], sysIdx[j]);
+  }
+  Double_t det(0);
+  vPP.Invert(&det);
+  if (0==det) {
+    cout<<" Singular covariance matrix for varied params"<<endl;
+    delete fr;
+    return kFALSE;
+  }
+  sensM.Mult(vSP, vPP);
+  delete fr;
+  return retVal;
+}
+
+/// \brief Calculate linearized systematic errors
+/// \param iParam Index of param currently being studied
+/// \param sensM Sensitivity matrix from #getSysSensitivity
+/// \param sysParamList All params to vary (columns of \p sensM)
+/// \param theParams Params varied for this systematic
+/// \param myV Variant
+/// \param useErr If the variant is unit of error or not
+/// \param isPlus Plus variation
+/// \param eArray Array to store errors
+void rarMLFitter::calLinSysErrors(Int_t iParam, TMatrixD &sensM,
+                                  RooArgList &sysParamList,
+                                  RooArgSet &theParams, Double_t myV,
+                                  Bool_t useErr, Bool_t isPlus,
+                                  TArrayD &eArray)
+{
+  Int_t nStudyVars=sensM.GetNrows();
+  for (Int_t i=0; i<nStudyVars; i++) {
+    Double_t shift(0);
+    TIterator* iter = theParams.createIterator();
+    RooRealVar *theParam(0);
+    while(theParam=(RooRealVar*)iter->Next()) {
+      Int_t j=sysParamList.index(theParam->GetName());
+      if (j<0) continue;
+      shift+=sensM(i,j)*getVariation(theParam, myV, useErr, isPlus);
+    }
+    delete iter;
+    eArray[iParam*nStudyVars+i]=shift;
+  }
+}
+
+/// \brief Output systematic error table
+/// \param o Output stream
+/// \param tableName Title of the table
+/// \param studyVarList Vars studied
+/// \param vParams Variant param names
+/// \param paramNameLen Max length for param name
+/// \param pV Positve variations
+/// \param pArray Positve errors
+/// \param mV Negative variations
+/// \param mArray Negative errors
+/// \param corrM1 Correlation matrix w/o correlations (diagonal)
+/// \param corrM Correlation matrix
+///
+/// It outputs the error table, the total errors,
+/// and the correlations of the total systematic errors of the study vars.
+void rarMLFitter::outSysTable(ostream &o, TString tableName,
+                              RooArgList studyVarList, TString vParams,
+                              Int_t paramNameLen,
+                              TArrayD &pV, TArrayD &pArray,
+                              TArrayD &mV, TArrayD &mArray,
+                              TMatrixD corrM1, TMatrixD corrM)
+{
+  Int_t nSysParams=pV.GetSize();
+  TArrayD aArray(pArray.GetSize()); // avg error
+  o<<endl<<tableName<<endl;
   o<<setw(paramNameLen+11)<<" ";
   // output obs names
-  RooArgList studyVarList(studyVars);
   for (Int_t i=0; i<studyVarList.getSize(); i++) {
     o<<setw(40)<<studyVarList[i].GetName();
   }
@@ -978,9 +1242,24 @@ void rarMLFitter::doSysStudy(RooDataSet *mlFitData, TString paramsStr,
   // final error output
   outSysErrors(o, "(w/o corr):", paramNameLen, corrM1, aArray);
   outSysErrors(o, "(w/ corr):", paramNameLen, corrM, aArray);
-  // restore saved params
-  readFromStr(fullParams, fParamSStr0);
-  return;
+  // correlations of the systematic errors between study vars
+  Int_t nSysVars=studyVarList.getSize();
+  TMatrixD errM(nSysParams, nSysVars);
+  for (Int_t j=0; j<nSysParams; j++)
+    for (Int_t i=0; i<nSysVars; i++) errM(j,i)=aArray[j*nSysVars+i];
+  TMatrixD errMT(TMatrixD::kTransposed, errM);
+  TMatrixD sysCovM(errMT, TMatrixD::kMult, corrM*errM);
+  o<<setw(paramNameLen)<<"sys corr:"<<endl;
+  o.unsetf(ios_base::scientific);
+  o.precision(4);
+  for (Int_t i=0; i<nSysVars; i++) {
+    o<<setw(paramNameLen)<<studyVarList[i].GetName()<<setw(11)<<" ";
+    for (Int_t j=0; j<nSysVars; j++) {
+      Double_t den=sqrt(sysCovM(i,i)*sysCovM(j,j));
+      o<<setw(40)<<(den>0 ? sysCovM(i,j)/den : 0.);
+    }
+    o<<endl;
+  }
 }
 
 /// \brief Set variation for all params specified
@@ -994,23 +1273,8 @@ void rarMLFitter::setVariation(RooArgSet theParams, Double_t myV,
   TIterator* iter = theParams.createIterator();
   RooRealVar *theParam(0);
   while(theParam=(RooRealVar*)iter->Next()) {
-    Double_t myVariant=myV;
-    if (useErr) {
-      Double_t myErr(0);
-      if (theParam->hasAsymError()) {
-	if (isPlus) myErr=theParam->getAsymErrorHi();
-	else myErr=theParam->getAsymErrorLo();
-      }
-      if ((0==myErr)&&(theParam->hasError()))
-	myErr=theParam->getError();
-      if (0==myErr) {
-	cout<<" No err specified for "<<theParam->GetName()<<endl;
-	continue;
-      }
-      myVariant=myV*myErr;
-    }
-    myVariant=fabs(myVariant);
-    if (!isPlus) myVariant=-myVariant;
+    Double_t myVariant=getVariation(theParam, myV, useErr, isPlus);
+    if (0==myVariant) continue;
     cout<<" Variation for "<<theParam->GetName()<<": "<<myVariant<<endl;
     theParam->setVal(theParam->getVal()+myVariant);
   }
@@ -1018,6 +1282,35 @@ void rarMLFitter::setVariation(RooArgSet theParams, Double_t myV,
   return;
 }
 
+/// \brief Return variation of a param
+/// \param theParam The param to vary
+/// \param myV Variant
+/// \param useErr If the variant is unit of error or not
+/// \param isPlus Plus variation
+/// \return The signed variation (0 if no error for \p useErr)
+Double_t rarMLFitter::getVariation(RooRealVar *theParam, Double_t myV,
+                                   Bool_t useErr, Bool_t isPlus)
+{
+  Double_t myVariant=myV;
+  if (useErr) {
+    Double_t myErr(0);
+    if (theParam->hasAsymError()) {
+      if (isPlus) myErr=theParam->getAsymErrorHi();
+      else myErr=theParam->getAsymErrorLo();
+    }
+    if ((0==myErr)&&(theParam->hasError()))
+      myErr=theParam->getError();
+    if (0==myErr) {
+      cout<<" No err specified for "<<theParam->GetName()<<endl;
+      return 0;
+    }
+    myVariant=myV*myErr;
+  }
+  myVariant=fabs(myVariant);
+  if (!isPlus) myVariant=-myVariant;
+  return myVariant;
+}
+
 /// \brief Calculate systematic errors
 /// \param iParam Index of param currently being studied
 /// \param cstudyVars Vars to study (original values)
@@ -1690,6 +1983,11 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
 
   // get number of cpus option
   Int_t toyFitNumCPU=atoi(readConfStr("useNumCPU", "1", getMasterSec()));
+  // fit driver for toy fits (minimizer, retries, budgets)
+  rarFitDriver toyFitDriver;
+  setupFitDriver(toyFitDriver);
+  toyFitDriver.setCacheDir(""); // toy samples never repeat
+  Bool_t useToyFitDriver=!toyFitDriver.isPlainFit();
 
   // now see if we have toyFitMinos (do Minos only for some parameters)
   RooArgSet toyFitMinosAS;
@@ -2067,13 +2365,39 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
           }
         }
       }
+      // status and number of attempts of each toy fit
+      TArrayI toyFitStatus(nExpPerLoop), toyFitTries(nExpPerLoop);
+      toyFitTries.Reset(1);
       if ("no"!=readConfStr("toyGenerate", "yes", _runSec)) {
-        // construct dataset list
-        TList genSamples;
-        Int_t nSamples=nExpPerLoop;
-        while (nSamples--) genSamples.Add(theToy->genData(nSamples)->Clone());
-        theToy->fit(nExpPerLoop, genSamples);
+        if (useToyFitDriver) {
+          // fit samples (in the same order as below) through fit driver
+          // and hand the results to RooMCStudy
+          Int_t nSamples=nExpPerLoop;
+          Int_t iFit=0;
+          while (nSamples--) {
+            readFromStr(fullParams, randParamSStr);
+            RooFitResult *fr=
+              toyFitDriver.fit(_thePdf, (RooAbsData*)theToy->genData(nSamples),
+                               fitOpt, _conditionalObs, toyFitNumCPU,
+                               &toyFitMinosAS);
+            toyFitStatus[iFit]=toyFitDriver.getStatus();
+            toyFitTries[iFit]=toyFitDriver.getNTries();
+            iFit++;
+            theToy->addFitResult(*fr);
+          }
+        } else {
+          // construct dataset list
+          TList genSamples;
+          Int_t nSamples=nExpPerLoop;
+          while (nSamples--) genSamples.Add(theToy->genData(nSamples)->Clone());
+          theToy->fit(nExpPerLoop, genSamples);
+        }
       } else {
+        if (useToyFitDriver)
+          cout<<"Toy W A R N I N G ! ! !"<<endl
+              <<" Fit driver configs do not apply to toy samples"
+              <<" read from files"<<endl;
+        useToyFitDriver=kFALSE;
         theToy->fit(nExpPerLoop, toyFileName);
       }
       // pulls for embedded toy are not right, re-calculate
@@ -2133,6 +2457,10 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
 	fitParData.addColumn(numInvalidNLL);
 	RooRealVar edm("edm", "edm", 0);
 	fitParData.addColumn(edm);
+	if (useToyFitDriver) {
+	  RooRealVar fitTries("fitTries", "fitTries", 1);
+	  fitParData.addColumn(fitTries);
+	}
 	
         // add gof chisq
         RooRealVar GOFChisq("GOFChisq", "GOFChisq", 0);
@@ -2144,11 +2472,17 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
       }
       // merge w/ toy IDs and check if all toy fits converged
       Int_t ii=0;
+      Int_t nFailed=0;
       for (Int_t i=0; i<nExpPerLoop; i++) {
 	RooFitResult *fr=(RooFitResult*)theToy->fitResult(i);
-	if (fr->status()) {
+	if (!useToyFitDriver) toyFitStatus[i]=fr->status();
+	if (toyFitStatus[i]) {
 	  cout<<"Toy Fit status for experiment #"<<expIdx<<"-"<<nExpPerLoop-i
-	      <<": "<<fr->status()<<endl;
+	      <<": "<<toyFitStatus[i]<<" after "<<toyFitTries[i]
+	      <<" attempt(s)"<<endl;
+	  nFailed++;
+	  // RooMCStudy keeps params for all fits with zero status
+	  if (0==fr->status()) ii++;
 	  continue;
 	}
 	RooArgSet *fitResultSet=(RooArgSet *)theToy->fitParams(ii);
@@ -2170,6 +2504,8 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
 	((RooRealVar*)fitResultSet->find("numInvalidNLL"))
 	  ->setVal(fr->numInvalidNLL());
 	((RooRealVar*)fitResultSet->find("edm"))->setVal(fr->edm());
+	if (useToyFitDriver)
+	  ((RooRealVar*)fitResultSet->find("fitTries"))->setVal(toyFitTries[i]);
 	
         // gof chisq
         Double_t gofChisq(0);
@@ -2181,6 +2517,10 @@ RooDataSet *rarMLFitter::doToyStudy(RooArgSet fullParams)
 	toyResults->add(*fitResultSet);
 	ii++;
       }
+      if (nFailed>0) {
+	cout<<"Toy "<<nFailed<<" of "<<nExpPerLoop
+	    <<" fits failed in loop #"<<expIdx<<endl;
+      }
     }
     delete theToy;
     firstToy=kFALSE;
@@ -2203,8 +2543,8 @@ void rarMLFitter::getCompCatDS(TList*ds,RooDataSet *iData,RooCategory *compCat)
   catSet.remove(_compCat, kFALSE, kTRUE);
   catSet.remove(_protDataEVars, kFALSE, kTRUE);
   if (catSet.getSize()<=0) {
-    RooDataSet *theData=(RooDataSet*)iData->reduce("1");
-    theData->SetName("noCompCatDS");
+    // a copy (columns may be added), w/o evaluating any cut
+    RooDataSet *theData=new RooDataSet(*iData, "noCompCatDS");
     if (compCat) {
       theData->addColumn(*compCat);
       theData->SetName(compCat->getLabel());
@@ -4113,6 +4453,7 @@ RooPlot *rarMLFitter::doContourPlot(TList &plotList)
       <<contX->GetName()<<" vs "<<contY->GetName()<<endl<<endl;
   RooNLLVar nll("nll","nll",*_thePdf, *contourPlotData, kTRUE);
   rarMinuit min(nll);
+  min.optimizeConst(kTRUE);
   if      (nContours<=1) frame = min.contour(*contX, *contY, 1, 0);
   else if (2==nContours) frame = min.contour(*contX, *contY, 1, 2);
   else if (3==nContours) frame = min.contour(*contX, *contY, 1, 2, 3);
@@ -4767,20 +5108,7 @@ RooPlot *rarMLFitter::doSPlot(RooRealVar *theVar, TList &plotList)
   //  theFullPdfWOvar->fitTo(*sPlotData, _conditionalObs,"ehmr");
 
   TString fitOption("qemhr");
-
-  // convert to newer fitTo format for steering options
-  Bool_t sPlotExtended = fitOption.Contains("e");
-  Bool_t sPlotMinos    = fitOption.Contains("m");
-  Bool_t sPlotHesse    = fitOption.Contains("h");
-  Bool_t sPlotVerbose  = !fitOption.Contains("q");
-  Bool_t sPlotSave     = fitOption.Contains("r"); // return results
-  RooFitResult *fitStat=
-    theFullPdfWOvar->fitTo(*sPlotData, ConditionalObservables(_conditionalObs),
-  			   Save(sPlotSave), Extended(sPlotExtended), 
-			   Verbose(sPlotVerbose), Hesse(sPlotHesse),
-			   Minos(sPlotMinos));
-  //Int_t ncpus(1);
-  //RooFitResult *fitStat=doTheFit(theFullPdfWOvar, sPlotData, fitOption, ncpus);
+  RooFitResult *fitStat=doTheFit(theFullPdfWOvar, sPlotData, fitOption);
 
   // create sPlot obj
   TString sPlotName=Form("sPlot_%s", theVar->GetName());
@@ -5220,12 +5548,17 @@ TTree *rarMLFitter::createTreeFromDataset(const RooDataSet *ds,
 /// It is advisable to divide the action config section accordingly
 /// and run the program with different config section (option -A)
 /// for each type of job.
+/// With config \p normIntCache = \p yes in the master section,
+/// numerical integrals are cached and kept on disk
+/// for later runs (see #loadNormIntCache).
 ///
 /// \todo It is possible and more elegant to have this function
 ///       divided into several different functions according to
 ///       fitting job type.
 void rarMLFitter::run()
 {
+  // persistent normalization integrals
+  loadNormIntCache();
   // first have pre-actions done for each RooRarFitPdf
   cout<<endl<<" Pre-Actions for each RooRarFitPdf"<<endl<<endl;
   preAction();
@@ -5586,4 +5919,124 @@ void rarMLFitter::run()
     plotFile.Close();
     cout<<"Writing out combine plots to "<<combinePlotFile<<endl;
   } // done combine plot
+  
+  // save normalization integrals for next run
+  saveNormIntCache();
+}
+
+/// \brief Get file of persistent integral cache
+/// \param ownerNodes All pdf nodes of the model (filled)
+/// \return Cache file name
+///
+/// The file name is the MD5 hash of the structure of all pdfs created
+/// (class, name and args of each node),
+/// the ranges (all binnings) of the observables,
+/// and the integrator precision,
+/// so cached integrals are only used for the same model.
+TString rarMLFitter::getNormIntCacheFile(RooArgList &ownerNodes)
+{
+  RooArgSet nodeSet;
+  for (Int_t i=0; i<_rarPdfs.GetSize(); i++) {
+    RooAbsPdf *thePdf=((rarBasePdf*)_rarPdfs.At(i))->getPdf();
+    if (!thePdf) continue;
+    RooArgList nodes;
+    thePdf->branchNodeServerList(&nodes);
+    nodeSet.add(nodes, kTRUE);
+  }
+  RooArgList nodes;
+  _thePdf->branchNodeServerList(&nodes);
+  nodeSet.add(nodes, kTRUE);
+  ownerNodes.removeAll();
+  ownerNodes.add(nodeSet);
+  ownerNodes.sort();
+  
+  stringstream keyStr;
+  keyStr<<setprecision(17);
+  // model structure
+  for (Int_t i=0; i<ownerNodes.getSize(); i++)
+    ownerNodes.at(i)->printStream(keyStr, RooPrintable::kClassName|
+                                  RooPrintable::kName|RooPrintable::kArgs,
+                                  RooPrintable::kSingleLine);
+  // observable ranges
+  RooArgList obsList(*_fullObs);
+  obsList.sort();
+  for (Int_t i=0; i<obsList.getSize(); i++) {
+    RooRealVar *theObs=dynamic_cast<RooRealVar*>(obsList.at(i));
+    if (!theObs) continue;
+    keyStr<<theObs->GetName()<<" "<<theObs->getMin()<<" "<<theObs->getMax();
+    std::list<std::string> binningNames=theObs->getBinningNames();
+    binningNames.sort();
+    for (std::list<std::string>::iterator it=binningNames.begin();
+         it!=binningNames.end(); ++it)
+      keyStr<<" "<<*it<<" "<<theObs->getMin(it->c_str())
+            <<" "<<theObs->getMax(it->c_str());
+    keyStr<<endl;
+  }
+  // integrator precision
+  keyStr<<RooAbsReal::defaultIntegratorConfig()->epsAbs()<<" "
+        <<RooAbsReal::defaultIntegratorConfig()->epsRel()<<endl;
+  
+  TMD5 md5;
+  string theKeyStr=keyStr.str();
+  md5.Update((UChar_t*)theKeyStr.c_str(), theKeyStr.length());
+  md5.Final();
+  
+  return _resultDir+"/normIntCache/"+md5.AsString()+".root";
+}
+
+/// \brief Load persistent integral cache
+///
+/// With config \p normIntCache = \p yes in the master section,
+/// numerical integrals of \p normIntCacheDim (default 2, as RooFit)
+/// or more dimensions are cached by RooFit,
+/// keyed by the integral (pdf, observables, normalization set, range)
+/// and the param values.
+/// The cache saved by a previous run of the same model
+/// (see #getNormIntCacheFile) is loaded first,
+/// so integrals with the same param values,
+/// eg, of fixed components, are not integrated again.
+void rarMLFitter::loadNormIntCache()
+{
+  if ("yes"!=readConfStr("normIntCache", "no", getMasterSec())) return;
+  Int_t minDim=atoi(readConfStr("normIntCacheDim", "2", getMasterSec()));
+  RooRealIntegral::setCacheAllNumeric(minDim);
+  RooArgList ownerNodes;
+  _normIntCacheFile=getNormIntCacheFile(ownerNodes);
+  if (gSystem->AccessPathName(_normIntCacheFile)) {
+    cout<<" Normalization integral cache "<<_normIntCacheFile
+        <<" will be created"<<endl;
+    return;
+  }
+  TDirectory *curDir=gDirectory;
+  TFile f(_normIntCacheFile);
+  RooExpensiveObjectCache *theCache=
+    dynamic_cast<RooExpensiveObjectCache*>(f.Get("normIntCache"));
+  if (theCache) {
+    for (Int_t i=0; i<ownerNodes.getSize(); i++)
+      RooExpensiveObjectCache::instance().
+        importCacheObjects(*theCache, ownerNodes.at(i)->GetName(), kFALSE);
+    cout<<" Normalization integrals restored from "<<_normIntCacheFile<<endl;
+  }
+  delete theCache;
+  f.Close();
+  if (curDir) curDir->cd();
+}
+
+/// \brief Save persistent integral cache
+///
+/// It writes the RooFit integral cache to #_normIntCacheFile.
+void rarMLFitter::saveNormIntCache()
+{
+  if (""==_normIntCacheFile) return;
+  TString cacheDir=gSystem->DirName(_normIntCacheFile);
+  if (gSystem->AccessPathName(cacheDir)&&gSystem->mkdir(cacheDir, kTRUE)) {
+    cout<<" Can not create integral cache dir "<<cacheDir<<endl;
+    return;
+  }
+  TDirectory *curDir=gDirectory;
+  TFile f(_normIntCacheFile, "recreate");
+  RooExpensiveObjectCache::instance().Write("normIntCache");
+  f.Close();
+  if (curDir) curDir->cd();
+  cout<<" Normalization integrals saved to "<<_normIntCacheFile<<endl;
 }
@@ -0,0 +1,433 @@
+/*****************************************************************************
+* Project: BaBar detector at the SLAC PEP-II B-factory
+* Package: RooRarFit
+ *    File: $Id$
+ * Authors:
+ * History:
+ *
+ * Copyright (C) 2005-2012, University of California, Riverside
+ *****************************************************************************/
+
+// -- CLASS DESCRIPTION [PDF] --
+// This class provides pdf wrapper with interpolated normalization
+//////////////////////////////////////////////////////
+//
+// BEGIN_HTML
+// This class provides pdf wrapper with interpolated normalization
+// END_HTML
+//
+
+#include "rarVersion.hh"
+
+#include "Riostream.h"
+#include <map>
+#include <string>
+
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TMath.h"
+#include "TObjString.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+#include "RooAbsRealLValue.h"
+#include "RooArgSet.h"
+
+#include "rarNormCachePdf.hh"
+
+ClassImp(rarNormCachePdf)
+  ;
+
+/// \brief Grid cache shared by all clones of a rarNormCachePdf
+///
+/// It holds the node integrals and the cell checks for one cache id,
+/// which encodes everything the grid depends on.
+/// Only the id last saved is kept in the file.
+class rarNormCache {
+
+public:
+  rarNormCache(TString fileName)
+    : _fileName(fileName), _fileChecked(kFALSE),
+      _nRefs(1), _dirty(kFALSE), _nBadCells(0),
+      _nSwitches(0), _nHits(0), _disabled(kFALSE) {}
+
+  void setId(TString id);
+  void save();
+  static std::string getKey(const TArrayI &idx);
+
+  TString _fileName; ///< Cache file
+  TString _fileId; ///< Cache id in the file
+  Bool_t _fileChecked; ///< Cache id in the file has been read
+  TString _id; ///< Current cache id
+  Int_t _nRefs; ///< Number of wrappers sharing the cache
+  Bool_t _dirty; ///< Unsaved changes
+  Int_t _nBadCells; ///< Number of cells failing the tolerance
+  Int_t _nSwitches; ///< Number of id changes
+  Int_t _nHits; ///< Number of nodes found in the cache
+  Bool_t _disabled; ///< Id changes too often for the cache to help
+  std::map<std::string, Double_t> _nodes; ///< Node integrals
+  std::map<std::string, Bool_t> _cells; ///< Cell checks
+
+protected:
+  void load();
+};
+
+/// \brief Switch to a cache id
+/// \param id The cache id
+///
+/// If the id changes, the grid is saved and cleared,
+/// and reloaded from the file if the file holds the new id.
+/// If the id keeps changing without the grid being reused
+/// (eg, a floating param is not gridded), the cache is disabled.
+void rarNormCache::setId(TString id)
+{
+  if (id==_id) return;
+  if ((++_nSwitches>20)&&(_nHits<_nSwitches)) {
+    if (!_disabled)
+      cout<<" W A R N I N G !"<<endl
+          <<" Normalization grid id keeps changing,"
+          <<" disable the cache for "<<_fileName<<endl;
+    _disabled=kTRUE;
+    return;
+  }
+  save();
+  _nodes.clear();
+  _cells.clear();
+  _nBadCells=0;
+  _dirty=kFALSE;
+  _id=id;
+  if (!_fileChecked) {
+    _fileChecked=kTRUE;
+    if (""==_fileName||gSystem->AccessPathName(_fileName)) return;
+    TDirectory *curDir=gDirectory;
+    TFile f(_fileName);
+    TObjString *fileId=dynamic_cast<TObjString*>(f.Get("normCacheId"));
+    if (fileId) _fileId=fileId->GetString();
+    f.Close();
+    if (curDir) curDir->cd();
+  }
+  if (_id==_fileId) load();
+}
+
+/// \brief Load the grid from the file
+void rarNormCache::load()
+{
+  TDirectory *curDir=gDirectory;
+  TFile f(_fileName);
+  TTree *tree=dynamic_cast<TTree*>(f.Get("normCache"));
+  if (tree) {
+    Char_t key[1024];
+    Double_t val(0);
+    Int_t type(0);
+    tree->SetBranchAddress("key", key);
+    tree->SetBranchAddress("val", &val);
+    tree->SetBranchAddress("type", &type);
+    for (Long64_t i=0; i<tree->GetEntries(); i++) {
+      tree->GetEntry(i);
+      if (0==type) _nodes[key]=val;
+      else _cells[key]=(val>0);
+    }
+    cout<<" Normalization grid loaded from "<<_fileName<<": "
+        <<_nodes.size()<<" nodes, "<<_cells.size()<<" cells"<<endl;
+  }
+  f.Close();
+  if (curDir) curDir->cd();
+}
+
+/// \brief Save the grid to the file if it has changed
+void rarNormCache::save()
+{
+  if (!_dirty||(""==_fileName)) return;
+  TString dirName=gSystem->DirName(_fileName);
+  if (gSystem->AccessPathName(dirName)&&gSystem->mkdir(dirName, kTRUE)) {
+    cout<<" Can not create normalization cache dir "<<dirName<<endl;
+    return;
+  }
+  TDirectory *curDir=gDirectory;
+  TFile f(_fileName, "recreate");
+  TObjString fileId(_id);
+  fileId.Write("normCacheId");
+  TTree tree("normCache", "normalization grid");
+  Char_t key[1024];
+  Double_t val(0);
+  Int_t type(0);
+  tree.Branch("key", key, "key/C");
+  tree.Branch("val", &val, "val/D");
+  tree.Branch("type", &type, "type/I");
+  std::map<std::string, Double_t>::iterator nIter;
+  for (nIter=_nodes.begin(); nIter!=_nodes.end(); nIter++) {
+    strncpy(key, nIter->first.c_str(), sizeof(key)-1);
+    key[sizeof(key)-1]=0;
+    val=nIter->second;
+    type=0;
+    tree.Fill();
+  }
+  std::map<std::string, Bool_t>::iterator cIter;
+  for (cIter=_cells.begin(); cIter!=_cells.end(); cIter++) {
+    strncpy(key, cIter->first.c_str(), sizeof(key)-1);
+    key[sizeof(key)-1]=0;
+    val=cIter->second ? 1 : 0;
+    type=1;
+    tree.Fill();
+  }
+  tree.Write();
+  f.Close();
+  if (curDir) curDir->cd();
+  _fileId=_id;
+  _fileChecked=kTRUE;
+  _dirty=kFALSE;
+}
+
+/// \brief Return map key of grid indices
+/// \param idx The grid indices
+/// \return The key
+std::string rarNormCache::getKey(const TArrayI &idx)
+{
+  std::string key;
+  for (Int_t i=0; i<idx.GetSize(); i++) key+=Form("%d ", idx[i]);
+  return key;
+}
+
+/// \brief Default ctor
+///
+/// \param name The name
+/// \param title The title
+/// \param pdf The pdf to wrap
+/// \param x The observable
+/// \param shapeParams Shape params of the wrapped pdf
+/// \param steps Grid spacing of \p shapeParams (<=0 means no grid)
+/// \param tol Relative tolerance of interpolation
+/// \param cacheFile The cache file (none if not set)
+///
+/// Only floating RooRealVar params with positive spacing are gridded,
+/// the values of all other params are part of the cache id.
+rarNormCachePdf::rarNormCachePdf(const char *name, const char *title,
+                                 RooAbsPdf &pdf, RooAbsRealLValue &x,
+                                 const RooArgList &shapeParams,
+                                 const TArrayD &steps, Double_t tol,
+                                 const char *cacheFile)
+  : RooAbsPdf(name, title),
+    _pdf("pdf", "wrapped pdf", this, pdf),
+    _x("x", "observable", this, x),
+    _params("params", "shape params", this),
+    _steps(steps), _tol(tol), _integral(0),
+    _cache(new rarNormCache(cacheFile ? cacheFile : ""))
+{
+  _params.add(shapeParams);
+  if (_steps.GetSize()<_params.getSize()) _steps.Set(_params.getSize());
+}
+
+/// \brief Copy ctor
+///
+/// \param other The object to copy
+/// \param name The name of the new object
+///
+/// The copy shares the grid cache of \p other.
+rarNormCachePdf::rarNormCachePdf(const rarNormCachePdf &other,
+                                 const char *name)
+  : RooAbsPdf(other, name),
+    _pdf("pdf", this, other._pdf),
+    _x("x", this, other._x),
+    _params("params", this, other._params),
+    _steps(other._steps), _tol(other._tol), _integral(0),
+    _cache(other._cache)
+{
+  _cache->_nRefs++;
+}
+
+/// \brief Dtor
+///
+/// It saves the grid cache if it has changed,
+/// so grids built in fits with clones are kept.
+rarNormCachePdf::~rarNormCachePdf()
+{
+  if (_integral) delete _integral;
+  _cache->save();
+  if (--_cache->_nRefs<=0) delete _cache;
+}
+
+/// \brief Save the grid cache to its file
+void rarNormCachePdf::saveCache() const
+{
+  _cache->save();
+}
+
+/// \brief Return unnormalized value of the wrapped pdf
+Double_t rarNormCachePdf::evaluate() const
+{
+  return ((RooAbsPdf&)_pdf.arg()).getVal((RooArgSet*)0);
+}
+
+/// \brief Claim integral over the full range of x
+Int_t rarNormCachePdf::getAnalyticalIntegral(RooArgSet &allVars,
+                                             RooArgSet &analVars,
+                                             const char *rangeName) const
+{
+  if (rangeName&&strlen(rangeName)) return 0;
+  if (matchArgs(allVars, analVars, _x)) return 1;
+  return 0;
+}
+
+/// \brief Return normalization interpolated from the grid
+/// \param code Integral code
+/// \return The integral over the full range of x
+Double_t rarNormCachePdf::analyticalIntegral(Int_t code,
+                                             const char * /*rangeName*/) const
+{
+  assert(1==code);
+  TArrayI gridded;
+  _cache->setId(getCacheId(gridded));
+  if (_cache->_disabled) return exactIntegral();
+  Int_t nDim=gridded.GetSize();
+  // lower corner of the cell
+  TArrayI lo(nDim);
+  TArrayD frac(nDim), center(nDim);
+  for (Int_t d=0; d<nDim; d++) {
+    Double_t step=_steps[gridded[d]];
+    Double_t u=((RooAbsReal*)_params.at(gridded[d]))->getVal()/step;
+    lo[d]=(Int_t)TMath::Floor(u);
+    frac[d]=u-lo[d];
+    center[d]=(lo[d]+.5)*step;
+  }
+  // check the cell once
+  std::string cellKey=rarNormCache::getKey(lo);
+  std::map<std::string, Bool_t>::iterator cIter=_cache->_cells.find(cellKey);
+  Bool_t goodCell(kTRUE);
+  if (cIter!=_cache->_cells.end()) {
+    goodCell=cIter->second;
+  } else if (nDim>0) {
+    Bool_t ok(kTRUE);
+    TArrayD halves(nDim);
+    halves.Reset(.5);
+    Double_t iVal=interpolate(lo, halves, gridded, ok);
+    Double_t eVal=integralAt(center, gridded, ok);
+    if (ok) {
+      goodCell=(TMath::Abs(iVal-eVal)<=_tol*TMath::Abs(eVal));
+      _cache->_cells[cellKey]=goodCell;
+      _cache->_dirty=kTRUE;
+      if (!goodCell&&(1==++_cache->_nBadCells))
+        cout<<" W A R N I N G !"<<endl
+            <<" Normalization grid of "<<GetName()
+            <<" fails tolerance "<<_tol<<" in cell "<<cellKey<<endl
+            <<" Integrating exactly there (consider finer grid)"<<endl;
+    } else {
+      goodCell=kFALSE;
+    }
+  }
+  if (goodCell) {
+    Bool_t ok(kTRUE);
+    Double_t val=interpolate(lo, frac, gridded, ok);
+    if (ok) return val;
+  }
+  return exactIntegral();
+}
+
+/// \brief Interpolate multilinearly within a cell
+/// \param lo Lower corner of the cell
+/// \param frac Fractions within the cell
+/// \param gridded Indices of gridded params
+/// \param ok Set to false if a node can not be computed
+/// \return The interpolated integral
+Double_t rarNormCachePdf::interpolate(const TArrayI &lo, const TArrayD &frac,
+                                      const TArrayI &gridded, Bool_t &ok) const
+{
+  Int_t nDim=lo.GetSize();
+  Double_t val(0);
+  TArrayI node(nDim);
+  TArrayD nodeVals(nDim);
+  for (Int_t corner=0; corner<(1<<nDim); corner++) {
+    Double_t weight(1);
+    for (Int_t d=0; d<nDim; d++) {
+      Bool_t up=(corner>>d)&1;
+      weight*=up ? frac[d] : 1-frac[d];
+      node[d]=lo[d]+(up ? 1 : 0);
+      nodeVals[d]=node[d]*_steps[gridded[d]];
+    }
+    if (0==weight) continue;
+    std::string nodeKey=rarNormCache::getKey(node);
+    std::map<std::string, Double_t>::iterator nIter=
+      _cache->_nodes.find(nodeKey);
+    Double_t nodeVal(0);
+    if (nIter!=_cache->_nodes.end()) {
+      nodeVal=nIter->second;
+      _cache->_nHits++;
+    } else {
+      Bool_t nodeOk(kTRUE);
+      nodeVal=integralAt(nodeVals, gridded, nodeOk);
+      if (!nodeOk) {
+        ok=kFALSE;
+        return 0;
+      }
+      _cache->_nodes[nodeKey]=nodeVal;
+      _cache->_dirty=kTRUE;
+    }
+    val+=weight*nodeVal;
+  }
+  return val;
+}
+
+/// \brief Integrate the wrapped pdf at given param values
+/// \param vals Values of gridded params
+/// \param gridded Indices of gridded params
+/// \param ok Set to false if a value is out of its param range
+/// \return The integral over the full range of x
+///
+/// The gridded params are restored afterwards.
+Double_t rarNormCachePdf::integralAt(const TArrayD &vals,
+                                     const TArrayI &gridded, Bool_t &ok) const
+{
+  Int_t nDim=gridded.GetSize();
+  for (Int_t d=0; d<nDim; d++) {
+    RooAbsRealLValue *theParam=(RooAbsRealLValue*)_params.at(gridded[d]);
+    if ((vals[d]<theParam->getMin())||(vals[d]>theParam->getMax())) {
+      ok=kFALSE;
+      return 0;
+    }
+  }
+  TArrayD saved(nDim);
+  for (Int_t d=0; d<nDim; d++) {
+    RooAbsRealLValue *theParam=(RooAbsRealLValue*)_params.at(gridded[d]);
+    saved[d]=theParam->getVal();
+    theParam->setVal(vals[d]);
+  }
+  Double_t val=exactIntegral();
+  for (Int_t d=0; d<nDim; d++)
+    ((RooAbsRealLValue*)_params.at(gridded[d]))->setVal(saved[d]);
+  return val;
+}
+
+/// \brief Integrate the wrapped pdf numerically
+/// \return The integral over the full range of x at current params
+Double_t rarNormCachePdf::exactIntegral() const
+{
+  if (!_integral)
+    _integral=_pdf.arg().createIntegral(RooArgSet(_x.arg()));
+  return _integral->getVal();
+}
+
+/// \brief Return cache id and find gridded params
+/// \param gridded Set to indices of gridded params
+/// \return The cache id
+///
+/// The id has the wrapped pdf, the range of x,
+/// the spacing of gridded params, the values of all other params,
+/// and the tolerance.
+TString rarNormCachePdf::getCacheId(TArrayI &gridded) const
+{
+  TString id=Form("%s %s %s[%.17g,%.17g] tol=%g",
+                  _pdf.arg().ClassName(), _pdf.arg().GetName(),
+                  _x.arg().GetName(), _x.min(), _x.max(), _tol);
+  gridded.Set(0);
+  for (Int_t i=0; i<_params.getSize(); i++) {
+    RooAbsReal *theParam=(RooAbsReal*)_params.at(i);
+    RooAbsRealLValue *theLV=dynamic_cast<RooAbsRealLValue*>(theParam);
+    if (theLV&&(!theLV->isConstant())&&(_steps[i]>0)) {
+      gridded.Set(gridded.GetSize()+1);
+      gridded[gridded.GetSize()-1]=i;
+      id+=Form(" %s/%.17g", theParam->GetName(), _steps[i]);
+    } else {
+      id+=Form(" %s=%.17g", theParam->GetName(), theParam->getVal());
+    }
+  }
+  return id;
+}
@@ -100,4 +100,8 @@ void rarRelBreitWigner::init()
   // create pdf
   _thePdf=new RooRelBreitWigner(Form("the_%s", GetName()),_pdfType+" "+GetTitle(),
 				*_x, *_mean, *_width, *_radius, *_mass_a, *_mass_b, *_spin);
+  // interpolated normalization if configured
+  _thePdf=cacheNorm(_thePdf, _x, "mean width radius mass_a mass_b spin",
+                    RooArgList(*_mean, *_width, *_radius,
+                               *_mass_a, *_mass_b, *_spin));
 }
@@ -27,7 +27,7 @@
 #include "RooRealVar.h"
 #include "RooStringVar.h"
 
-#include "RooParametricStepFunction.h"
+#include "RooRarStepFunction.hh"
 
 #include "rarStep.hh"
 
@@ -76,7 +76,8 @@ rarStep::~rarStep()
 /// It first reads in #_nBins and #_limits info from its param config section,
 /// and creates \p H00 ... \p H\<nBins-1\> parameters
 /// by calling #createAbsReal,
-/// and finally it builds \p RooParametricStepFunction PDF.
+/// and finally it builds \p RooParametricStepFunction PDF
+/// (as RooRarStepFunction, which generates events by inverse CDF).
 void rarStep::init()
 {
   cout<<"init of rarStep for "<<GetName()<<":"<<endl;
@@ -116,7 +117,7 @@ void rarStep::init()
   
   // create pdf
   _thePdf=
-    new RooParametricStepFunction(Form("the_%s", GetName()),
-				  _pdfType+" "+GetTitle(),
-				  *_x, _coeffs, *_limits, _nBins);
+    new RooRarStepFunction(Form("the_%s", GetName()),
+                           _pdfType+" "+GetTitle(),
+                           *_x, _coeffs, *_limits, _nBins);
 }
@@ -21,7 +21,6 @@
 
 #include "Riostream.h"
 
-#include "TObjString.h"
 #include "RooArgList.h"
 #include "RooRealVar.h"
 #include "RooStringVar.h"
@@ -61,17 +60,14 @@ rarStrParser::rarStrParser(const TString str)
 ///
 /// \param aParser Source object
 rarStrParser::rarStrParser(const rarStrParser& aParser)
-  : TObject(aParser)
+  : TObject(aParser),
+    _str(aParser._str), _begs(aParser._begs), _lens(aParser._lens),
+    _first(aParser._first), _nStrs(aParser._nStrs), _idx(aParser._idx)
 {
-  _str=aParser._str;
-  // go through tokens and copy them
-  for (Int_t i=0; i<((rarStrParser&)aParser).nArgs(); i++)
-    _strs.Add(new TObjString(((rarStrParser&)aParser)[i]));
 }
 
 rarStrParser::~rarStrParser()
 {
-  _strs.Delete();
 }
 
 /// \brief Operator = with char pointer
@@ -101,25 +97,31 @@ void rarStrParser::operator=(const RooStringVar str)
 
 /// \brief Get the indexed token
 ///
-/// \param idx Token index in #_strs
-/// \return The indexed token
-TString &rarStrParser::operator[](const Int_t idx)
+/// \param idx Token index
+/// \return The indexed token (the whole string if out of range)
+TString rarStrParser::operator[](const Int_t idx) const
 {
-  TObjString *retVal=(TObjString*)_strs.At(idx);
-  if (retVal) return retVal->String();
-  return _str;
+  if ((idx<0)||(idx>=nArgs())) return _str;
+  return TString(_str.Data()+_begs[_first+idx], _lens[_first+idx]);
 }
 
 /// \brief Remove the indexed token
 ///
 /// \param idx The index of token to be removed
+///
+/// Removing the first token is O(1).
 void rarStrParser::Remove(const Int_t idx)
 {
-  TObject *val=_strs.At(idx);
-  if (val) {
-    _strs.Remove(val);
-    delete val;
+  if ((idx<0)||(idx>=nArgs())) return;
+  if (0==idx) {
+    _first++;
+    return;
+  }
+  for (Int_t i=_first+idx; i<_nStrs-1; i++) {
+    _begs[i]=_begs[i+1];
+    _lens[i]=_lens[i+1];
   }
+  _nStrs--;
 }
 
 /// \brief Check if have the token
@@ -127,7 +129,7 @@ void rarStrParser::Remove(const Int_t idx)
 /// \return true if found, false if not
 ///
 /// It checks if the parser has the token
-Bool_t rarStrParser::Have(const TString token) {
+Bool_t rarStrParser::Have(const TString token) const {
   return (Index(token)<0) ? kFALSE : kTRUE;
 }
 
@@ -136,25 +138,37 @@ Bool_t rarStrParser::Have(const TString token) {
 /// \return the index of the give token, -1 if not found
 ///
 /// It returns index for a given token, -1 if not found.
-Int_t rarStrParser::Index(const TString token) {
+/// Tokens are compared in place, without copying them out.
+Int_t rarStrParser::Index(const TString token) const {
   Int_t index(-1);
-  for (Int_t i=0; i<nArgs(); i++)
-    if (token==operator[](i)) return i;
+  for (Int_t i=_first; i<_nStrs; i++)
+    if ((token.Length()==_lens[i])&&
+        !strncmp(token.Data(), _str.Data()+_begs[i], _lens[i]))
+      return i-_first;
   return index;
 }
 
 /// \brief Initial function to parse a string
 ///
-/// It initializes #_idx and #_strs and
+/// It initializes #_idx and the token offsets and
 /// calls #nextToken to parse the string
 void rarStrParser::init()
 {
-  // reset index and parsed string objs
+  // reset index and parsed tokens
   _idx=0;
-  _strs.Delete();
-  TObjString *objStr(0);
-  while (objStr=nextToken()) {
-    _strs.Add(objStr);
+  _first=0;
+  _nStrs=0;
+  Int_t beg(0), len(0);
+  while (nextToken(beg, len)) {
+    if (_nStrs>=_begs.GetSize()) {
+      Int_t nSize=2*_begs.GetSize();
+      if (nSize<8) nSize=8;
+      _begs.Set(nSize);
+      _lens.Set(nSize);
+    }
+    _begs[_nStrs]=beg;
+    _lens[_nStrs]=len;
+    _nStrs++;
   }
 }
 
@@ -162,35 +176,38 @@ void rarStrParser::init()
 ///
 /// \todo Make quote (") regular character with `\"'.
 ///
+/// \param beg Offset of the token found
+/// \param len Length of the token found
+/// \return false if there is no more token
+///
 /// This is the actual parser.
 /// It ignores any blank characters at current position
 /// and return the sub-string until next blank character as the token.
 /// If current non-blank character is quote ("),
 /// it will take all characters after that until the next quote (")
 /// as token and return it.
-/// It return 0 (null) if current position, #_idx, is out of range.
-TObjString *rarStrParser::nextToken()
+/// It return false if current position, #_idx, is out of range.
+Bool_t rarStrParser::nextToken(Int_t &beg, Int_t &len)
 {
   Int_t nIdx(0);
-  if (_idx>=_str.Length()) return 0;
+  if (_idx>=_str.Length()) return kFALSE;
   while (' '==_str[_idx] || '\t'==_str[_idx] || '\n'==_str[_idx]) {
     _idx++;
-    if (_idx>=_str.Length()) return 0;
+    if (_idx>=_str.Length()) return kFALSE;
   }
   if ('"'==_str[_idx]) {
     _idx++;
     nIdx=_str.Index("\"", _idx);
-    if(nIdx<0) return 0;
+    if(nIdx<0) return kFALSE;
   } else {
     nIdx=_str.Index(" ", _idx);
     if(nIdx<0) nIdx=_str.Length();
   }
-  //cout<<"in Parser "<<nIdx<<" "<<_idx<<" "<<_str(_idx, nIdx-_idx)<<endl;
-  TString substr=_str(_idx, nIdx-_idx);
-  TObjString *subStr=new TObjString(substr);
+  beg=_idx;
+  len=nIdx-_idx;
   _idx=nIdx;
   if (_idx<_str.Length())
     if ('"'==_str[_idx]) _idx++;
   
-  return subStr;
+  return kTRUE;
 }
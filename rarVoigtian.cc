@@ -27,7 +27,7 @@
 #include "RooRealVar.h"
 #include "RooStringVar.h"
 
-#include "RooVoigtian.h"
+#include "RooRarVoigtian.hh"
 
 #include "rarVoigtian.hh"
 
@@ -76,6 +76,7 @@ rarVoigtian::~rarVoigtian()
 /// \p init is called by the ctor.
 /// It first creates the parameters by calling #createAbsReal,
 /// and finally it builds RooVoigtian PDF
+/// (as RooRarVoigtian, with the precision from config \p precision)
 /// with #_pdfType being Voigtian, respectively.
 void rarVoigtian::init()
 {
@@ -97,7 +98,8 @@ void rarVoigtian::init()
   _params.Print("v");
   
   // create pdf
-  Bool_t doFast = kTRUE;
-  _thePdf=new RooVoigtian(Form("the_%s", GetName()), _pdfType+" "+GetTitle(),
-			  *_x, *_mean, *_width, *_sigma, doFast);
+  Double_t precision=atof(readConfStr("precision", "1e-6", getVarSec()));
+  _thePdf=new RooRarVoigtian(Form("the_%s", GetName()),
+                             _pdfType+" "+GetTitle(),
+                             *_x, *_mean, *_width, *_sigma, precision);
 }